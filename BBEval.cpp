@@ -17,6 +17,7 @@ along with this program.If not, see < https://www.gnu.org/licenses/>.
 */
 
 #include <math.h>
+#include <thread>
 #include "Myrddin.h"
 #include "Bitboards.h"
 #include "Hash.h"
@@ -31,28 +32,15 @@ along with this program.If not, see < https://www.gnu.org/licenses/>.
 #if USE_EGTB
 #include "TBProbe.h"
 #endif
-
-int		nEval;
+#include "FEN.h"
 
 /*========================================================================
-** Evaluate - assign a "goodness" score to the current position on the
-** eval board
+** BBIsMaterialDraw - TRUE if BBEvaluate() scores the position as a draw
+** by insufficient material, without asking the network
 **========================================================================
 */
-int BBEvaluate(BB_BOARD *EvalBoard, int nAlpha, int nBeta)
+BOOL BBIsMaterialDraw(BB_BOARD *EvalBoard)
 {
-#if USE_EVAL_HASH
-    EVAL_HASH_ENTRY *found = ProbeEvalHash(EvalBoard->signature);
-	if (found)
-	{
-		if (found->nEval <= nAlpha)
-			return(nAlpha);
-		if (found->nEval >= nBeta)
-			return(nBeta);
-		return(found->nEval);
-	}
-#endif
-
 #if USE_EGTB
     if (!tb_available)  // if tablebases are not available, check for material draw
 #endif
@@ -61,28 +49,24 @@ int BBEvaluate(BB_BOARD *EvalBoard, int nAlpha, int nBeta)
 
         if (nTotalPieces == 2)
         {
-            nEval = 0;	// just kings on board
-            goto exit;
+            return(TRUE);	// just kings on board
         }
 
         if ((nTotalPieces == 3) && (BitCount(EvalBoard->bbPieces[BISHOP][WHITE] | EvalBoard->bbPieces[BISHOP][BLACK] | EvalBoard->bbPieces[KNIGHT][WHITE] | EvalBoard->bbPieces[KNIGHT][BLACK]) == 1))
         {
-            nEval = 0;	// king and minor vs king
-            goto exit;
+            return(TRUE);	// king and minor vs king
         }
 
         if (nTotalPieces == 4)
         {
             if ((BitCount(EvalBoard->bbPieces[BISHOP][WHITE] | EvalBoard->bbPieces[KNIGHT][WHITE]) == 1) && (BitCount(EvalBoard->bbPieces[BISHOP][BLACK] | EvalBoard->bbPieces[KNIGHT][BLACK]) == 1))
             {
-                nEval = 0;	// both sides have one minor, although, strictly speaking, it is possible to mate in these positions
-                goto exit;
+                return(TRUE);	// both sides have one minor, although, strictly speaking, it is possible to mate in these positions
             }
 
             if ((BitCount(EvalBoard->bbPieces[KNIGHT][WHITE] == 2)) || (BitCount(EvalBoard->bbPieces[KNIGHT][BLACK] == 2)))
             {
-                nEval = 0;	// KNNvK = DRAW!
-                goto exit;
+                return(TRUE);	// KNNvK = DRAW!
             }
 
             // rook vs minor
@@ -90,8 +74,7 @@ int BBEvaluate(BB_BOARD *EvalBoard, int nAlpha, int nBeta)
             {
                 if ((BitCount(EvalBoard->bbPieces[KNIGHT][BLACK] == 1)) || (BitCount(EvalBoard->bbPieces[BISHOP][BLACK] == 1)))
                 {
-                    nEval = 0;
-                    goto exit;
+                    return(TRUE);
                 }
             }
 
@@ -99,17 +82,65 @@ int BBEvaluate(BB_BOARD *EvalBoard, int nAlpha, int nBeta)
             {
                 if ((BitCount(EvalBoard->bbPieces[KNIGHT][WHITE] == 1)) || (BitCount(EvalBoard->bbPieces[BISHOP][WHITE] == 1)))
                 {
-                    nEval = 0;
-                    goto exit;
+                    return(TRUE);
                 }
             }
         }
     }
 
+    return(FALSE);
+}
+
+/*========================================================================
+** Evaluate - assign a "goodness" score to the current position on the
+** eval board, with the small network if bUseSmallNet and one is loaded
+**========================================================================
+*/
+int BBEvaluate(BB_BOARD *EvalBoard, int nAlpha, int nBeta, BOOL bUseSmallNet)
+{
+	int		nEval;
+
+#if USE_EVAL_HASH
+    EVAL_HASH_ENTRY *found = ProbeEvalHash(EvalBoard->signature);
+	if (found)
+	{
+		if (found->nEval <= nAlpha)
+			return(nAlpha);
+		if (found->nEval >= nBeta)
+			return(nBeta);
+		return(found->nEval);
+	}
+#endif
+
+    if (BBIsMaterialDraw(EvalBoard))
+    {
+        nEval = 0;
+        goto exit;
+    }
+
 #if !USE_INCREMENTAL_ACC_UPDATE
 	nn_update_all_pieces(EvalBoard->Accumulator, EvalBoard->bbPieces);
 #endif
 
+#if USE_SMALL_NET
+	if (bUseSmallNet && bSmallNet)
+	{
+#if USE_LAZY_ACC_UPDATE
+		if (EvalBoard == pAccBoard)
+			nEval = nn_evaluate_small(UpdateAccStack()->Accumulator, EvalBoard->sidetomove);
+		else
+#endif
+		nEval = nn_evaluate_small(EvalBoard->Accumulator, EvalBoard->sidetomove);
+
+		goto clamp;	// only the big network's scores go to the eval hash
+	}
+#endif
+
+#if USE_LAZY_ACC_UPDATE
+	if (EvalBoard == pAccBoard)
+		nEval = nn_evaluate(UpdateAccStack()->Accumulator, EvalBoard->sidetomove);
+	else
+#endif
 	nEval = nn_evaluate(EvalBoard->Accumulator, EvalBoard->sidetomove);
 
 exit:
@@ -117,9 +148,142 @@ exit:
     SaveEvalHash(nEval, EvalBoard->signature);
 #endif
 
+#if USE_SMALL_NET
+clamp:
+#endif
+
 	if (nEval <= nAlpha)
 		return(nAlpha);
 	if (nEval >= nBeta)
 		return(nBeta);
 	return(nEval);
 }
+
+#if !USE_CEREBRUM_1_0
+// positions read, evaluated and written at a time by EvalBatchFile()
+#define EVAL_BATCH_CHUNK	65536
+
+typedef struct
+{
+	Bitboard	bbPieces[6][2];
+	int			nColor;
+} BATCH_POSITION;
+
+/*========================================================================
+** EvalBatchThread - evaluates every nThreads-th group of NN_BATCH_SIZE
+** positions of a chunk, starting with group nThread
+**========================================================================
+*/
+static void EvalBatchThread(int nThread, int nThreads, BATCH_POSITION *bpPositions, int *nScores, int nPositions)
+{
+	NN_Accumulator	Accumulators[NN_BATCH_SIZE];
+	int				nColors[NN_BATCH_SIZE];
+	int				n, nFirst, nCount;
+
+	for (nFirst = nThread * NN_BATCH_SIZE; nFirst < nPositions; nFirst += nThreads * NN_BATCH_SIZE)
+	{
+		nCount = min(NN_BATCH_SIZE, nPositions - nFirst);
+
+		for (n = 0; n < nCount; n++)
+		{
+			nn_update_all_pieces(Accumulators[n], bpPositions[nFirst + n].bbPieces);
+			nColors[n] = bpPositions[nFirst + n].nColor;
+		}
+
+		nn_evaluate_batch(Accumulators, nColors, &nScores[nFirst], nCount);
+
+		for (n = 0; n < nCount; n++)
+			if (nColors[n] == BLACK)
+				nScores[nFirst + n] *= -1;
+	}
+}
+
+/*========================================================================
+** EvalBatchFile - scores every FEN of szInFile with the network on nCPUs
+** threads, and writes each line back to szOutFile followed by its score
+** from white's point of view. Lines that are not a valid FEN are skipped.
+** Returns the number of positions scored, or -1 if a file can't be opened
+**========================================================================
+*/
+int EvalBatchFile(char *szInFile, char *szOutFile, int *nSkipped)
+{
+	FILE			*fIn, *fOut;
+	BB_BOARD		Board;
+	BATCH_POSITION	*bpPositions;
+	char			(*szLines)[256];
+	int				*nScores;
+	std::thread		tEval[MAX_CPUS];
+	int				n, nLines, nTotal = 0;
+	char			*pEnd;
+
+	*nSkipped = 0;
+
+	fIn = fopen(szInFile, "r");
+	if (fIn == NULL)
+		return(-1);
+	fOut = fopen(szOutFile, "w");
+	if (fOut == NULL)
+	{
+		fclose(fIn);
+		return(-1);
+	}
+
+	bpPositions = (BATCH_POSITION *)malloc(EVAL_BATCH_CHUNK * sizeof(BATCH_POSITION));
+	szLines = (char (*)[256])malloc(EVAL_BATCH_CHUNK * 256);
+	nScores = (int *)malloc(EVAL_BATCH_CHUNK * sizeof(int));
+
+	if ((bpPositions == NULL) || (szLines == NULL) || (nScores == NULL))
+	{
+		nTotal = -1;
+		goto done;
+	}
+
+	for (;;)
+	{
+		// the FEN parser isn't reentrant, so the lines are read and parsed here and only the network runs on the threads
+		for (nLines = 0; nLines < EVAL_BATCH_CHUNK; )
+		{
+			if (fgets(szLines[nLines], 256, fIn) == NULL)
+				break;
+
+			pEnd = szLines[nLines] + strlen(szLines[nLines]);
+			while ((pEnd > szLines[nLines]) && ((pEnd[-1] == '\n') || (pEnd[-1] == '\r') || (pEnd[-1] == ' ')))
+				*--pEnd = 0;
+
+			if ((szLines[nLines][0] == 0) || (BBForsytheToBoard(szLines[nLines], &Board) < 0))
+			{
+				if (szLines[nLines][0])
+					(*nSkipped)++;
+				continue;
+			}
+
+			memcpy(bpPositions[nLines].bbPieces, Board.bbPieces, sizeof(bpPositions[nLines].bbPieces));
+			bpPositions[nLines].nColor = Board.sidetomove;
+			nLines++;
+		}
+
+		if (nLines == 0)
+			break;
+
+		for (n = 1; n < nCPUs; n++)
+			tEval[n] = std::thread(EvalBatchThread, n, nCPUs, bpPositions, nScores, nLines);
+		EvalBatchThread(0, nCPUs, bpPositions, nScores, nLines);
+		for (n = 1; n < nCPUs; n++)
+			tEval[n].join();
+
+		for (n = 0; n < nLines; n++)
+			fprintf(fOut, "%s %d\n", szLines[n], nScores[n]);
+
+		nTotal += nLines;
+	}
+
+done:
+	free(bpPositions);
+	free(szLines);
+	free(nScores);
+	fclose(fIn);
+	fclose(fOut);
+
+	return(nTotal);
+}
+#endif
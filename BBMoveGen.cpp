@@ -127,23 +127,143 @@ BOOL  BBKingInDanger(BB_BOARD *Board, int color)
 }
 
 /*========================================================================
-** BBAddToMoveList -- Adds a CHESSMOVE to a move list
+** BBSquareAttacked -- Is 'square' attacked by any piece of 'color' given
+** the occupancy 'occupied'. Used for king moves, with the king removed
+** from the occupancy so that it can't hide behind itself from a slider
 **========================================================================
 */
-void BBAddToMoveList(CHESSMOVE *legal_move_list, WORD *next_move, SquareType from_square, SquareType to_square,
-                     MoveFlagType moveflag, int score)
+static inline BOOL BBSquareAttacked(BB_BOARD *Board, int square, int color, Bitboard occupied)
 {
-    assert(*next_move >= 0 && *next_move < MAX_LEGAL_MOVES);
-    assert(legal_move_list);
+    IS_SQ_OK(square);
+    IS_COLOR_OK(color);
+
+    return((bbKnightMoves[square] & Board->bbPieces[KNIGHT][color]) ||
+           (bbKingMoves[square] & Board->bbPieces[KING][color]) ||
+           (bbPawnAttacks[color][square] & Board->bbPieces[PAWN][color]) ||
+           (Bmagic(square, occupied) & (Board->bbPieces[BISHOP][color] | Board->bbPieces[QUEEN][color])) ||
+           (Rmagic(square, occupied) & (Board->bbPieces[ROOK][color] | Board->bbPieces[QUEEN][color])));
+}
+
+/*========================================================================
+** BBGetPinned -- Returns bitboard of all pieces of 'color' that are
+** absolutely pinned to their king on 'kingsquare'
+**========================================================================
+*/
+static Bitboard BBGetPinned(BB_BOARD *Board, int kingsquare, int color)
+{
+    IS_SQ_OK(kingsquare);
+    IS_COLOR_OK(color);
+
+    int			opp = OPPONENT(color);
+    Bitboard	pinned = 0, between;
+    Bitboard	snipers;
+
+    // enemy sliders that would attack the king if none of our pieces were in the way
+    snipers = (Rmagic(kingsquare, Board->bbMaterial[opp]) & (Board->bbPieces[ROOK][opp] | Board->bbPieces[QUEEN][opp])) |
+              (Bmagic(kingsquare, Board->bbMaterial[opp]) & (Board->bbPieces[BISHOP][opp] | Board->bbPieces[QUEEN][opp]));
+
+    while (snipers)
+    {
+        between = bbSquaresBetween[kingsquare][BitScan(PopLSB(&snipers))] & Board->bbOccupancy;
+
+        // exactly one of our pieces in between means it is pinned
+        if (between && ((between & (between - 1)) == 0) && (between & Board->bbMaterial[color]))
+            pinned |= between;
+    }
+
+    return(pinned);
+}
+
+/*========================================================================
+** BBEnPassantIsLegal -- Does en passant capture from 'from' to 'to' leave
+** the king safe? Two pawns leave the rank at once so pin masks are not
+** enough, the resulting occupancy is tested instead
+**========================================================================
+*/
+static BOOL BBEnPassantIsLegal(BB_BOARD *Board, int from, int to, int kingsquare, int color)
+{
+    int			opp = OPPONENT(color);
+    Bitboard	occupied = (Board->bbOccupancy ^ Bit[from] ^ Bit[Board->epSquare]) | Bit[to];
+
+    if (bbKnightMoves[kingsquare] & Board->bbPieces[KNIGHT][opp])
+        return(FALSE);
+    if (bbPawnAttacks[opp][kingsquare] & Board->bbPieces[PAWN][opp] & ~Bit[Board->epSquare])
+        return(FALSE);
+    if (Bmagic(kingsquare, occupied) & (Board->bbPieces[BISHOP][opp] | Board->bbPieces[QUEEN][opp]))
+        return(FALSE);
+    if (Rmagic(kingsquare, occupied) & (Board->bbPieces[ROOK][opp] | Board->bbPieces[QUEEN][opp]))
+        return(FALSE);
+
+    return(TRUE);
+}
+
+/*========================================================================
+** BBPackMove -- Packs the squares and flags of a move into 16 bits
+**========================================================================
+*/
+PACKEDMOVE BBPackMove(SquareType from, SquareType to, MoveFlagType moveflag)
+{
+    IS_SQ_OK(from);
+    IS_SQ_OK(to);
+
+    PACKEDMOVE	pmMove = (PACKEDMOVE)(from | (to << 6));
+
+    if (moveflag & MOVE_PROMOTED)
+        pmMove |= PM_PROMOTION | (((moveflag & MOVE_PIECEMASK) - FIRST_PROMOTE) << 12);
+    else if (moveflag & MOVE_ENPASSANT)
+        pmMove |= PM_ENPASSANT;
+    else if (moveflag & (MOVE_OO | MOVE_OOO))
+        pmMove |= PM_CASTLE;
+
+    return(pmMove);
+}
+
+/*========================================================================
+** BBUnpackMove -- Fills in the squares and flags of a CHESSMOVE from a
+** packed move, finding captures from the board the move is to be made on
+**========================================================================
+*/
+void BBUnpackMove(BB_BOARD *Board, PACKEDMOVE pmMove, CHESSMOVE *move)
+{
+    SquareType		from = PM_FROM(pmMove), to = PM_TO(pmMove);
+    MoveFlagType	flag = 0;
+
+    switch (PM_SPECIAL(pmMove))
+    {
+        case PM_PROMOTION:
+            flag = MOVE_PROMOTED | PM_PROMOTED(pmMove);
+            break;
+        case PM_ENPASSANT:
+            flag = MOVE_ENPASSANT | MOVE_CAPTURE;
+            break;
+        case PM_CASTLE:
+            flag = (to > from) ? MOVE_OO : MOVE_OOO;
+            break;
+    }
+
+    if (Board->bbOccupancy & Bit[to])
+        flag |= MOVE_CAPTURE;
+
+    move->fsquare = from;
+    move->tsquare = to;
+    move->moveflag = flag;
+    move->nScore = 0;
+}
+
+/*========================================================================
+** BBAddToMoveList -- Adds a move to a move list
+**========================================================================
+*/
+void BBAddToMoveList(MOVELIST *mlMoves, SquareType from_square, SquareType to_square, MoveFlagType moveflag, int score)
+{
+    assert(mlMoves->nNumMoves >= 0 && mlMoves->nNumMoves < MAX_LEGAL_MOVES);
     IS_SQ_OK(from_square);
     IS_SQ_OK(to_square);
     assert(score >= 0);
 
-    legal_move_list[*next_move].fsquare = from_square;
-    legal_move_list[*next_move].tsquare = to_square;
-    legal_move_list[*next_move].moveflag = moveflag;
-    legal_move_list[*next_move].nScore = score;
-    (*next_move)++;
+    mlMoves->pmMoves[mlMoves->nNumMoves] = BBPackMove(from_square, to_square, moveflag);
+    mlMoves->nScores[mlMoves->nNumMoves] = score;
+    mlMoves->nNumMoves++;
 }
 
 /*========================================================================
@@ -159,20 +279,23 @@ int	BBScoreCapture(PieceType Capturer, PieceType Captured)
 }
 
 /*========================================================================
-** GenerateNormalMoves -- all moves for non-pawns, except castling
+** GenerateNormalMoves -- all legal moves for non-pawns, except castling.
+** Non-king moves are restricted to 'evasions' (all squares when not in
+** check) and pinned pieces to the line through their king
 **========================================================================
 */
-void BBGenerateNormalMoves(BB_BOARD *Board, CHESSMOVE *legal_move_list, WORD *next_move, int color,
-                           BOOL CapturesOnly)
+template <int color>
+void BBGenerateNormalMoves(BB_BOARD *Board, MOVELIST *mlMoves,
+                           int nGenType, Bitboard evasions, Bitboard pinned, int kingsquare)
 {
     IS_COLOR_OK(color);
-    assert(legal_move_list);
-    assert(*next_move >= 0 && *next_move <= MAX_LEGAL_MOVES);
+    assert(mlMoves);
+    assert(mlMoves->nNumMoves >= 0 && mlMoves->nNumMoves <= MAX_LEGAL_MOVES);
 
     Bitboard	moves, target, pieces;
     DWORD		dest;
     int			score = 0, piecetype;
-    int			opp = OPPONENT(color);
+    const int	opp = OPPONENT(color);
     BOOL		capture;
 
     for (piecetype = KING; piecetype < PAWN; piecetype++)
@@ -209,9 +332,19 @@ void BBGenerateNormalMoves(BB_BOARD *Board, CHESSMOVE *legal_move_list, WORD *ne
             // mask out moves that capture piece of same color
             moves &= ~Board->bbMaterial[color];
 
-            // if captures only, get rid of non-capture moves
-            if (CapturesOnly)
+            // if captures only, get rid of non-capture moves, and vice versa
+            if (nGenType == GEN_CAPTURES)
                 moves &= Board->bbMaterial[opp];
+            else if (nGenType == GEN_QUIETS)
+                moves &= ~Board->bbMaterial[opp];
+
+            // only moves that resolve a check, and pinned pieces stay on the pin line
+            if (piecetype != KING)
+            {
+                moves &= evasions;
+                if (piece & pinned)
+                    moves &= bbSquaresLine[kingsquare][square];
+            }
 
             while (moves)
             {
@@ -219,6 +352,10 @@ void BBGenerateNormalMoves(BB_BOARD *Board, CHESSMOVE *legal_move_list, WORD *ne
                 dest = BitScan(target);
                 capture = ((target & Board->bbMaterial[opp]) > 0);
 
+                // king can't move to an attacked square, including one "behind" itself on a slider's line
+                if ((piecetype == KING) && BBSquareAttacked(Board, dest, opp, Board->bbOccupancy ^ piece))
+                    continue;
+
                 if (capture && (PIECEOF(Board->squares[dest]) == KING))	// a bit of a hack, as this situation can occur when verifying checkmate
                     continue;
 
@@ -228,7 +365,7 @@ void BBGenerateNormalMoves(BB_BOARD *Board, CHESSMOVE *legal_move_list, WORD *ne
                 else
                     score = 0;
 
-                BBAddToMoveList(legal_move_list, next_move, (SquareType)square, (SquareType)dest, (MoveFlagType)(capture ? MOVE_CAPTURE : 0), score);
+                BBAddToMoveList(mlMoves, (SquareType)square, (SquareType)dest, (MoveFlagType)(capture ? MOVE_CAPTURE : 0), score);
             }
         }
     }
@@ -238,13 +375,14 @@ void BBGenerateNormalMoves(BB_BOARD *Board, CHESSMOVE *legal_move_list, WORD *ne
 ** GenerateCastles -- generates legal castles only!
 **========================================================================
 */
-void BBGenerateCastles(BB_BOARD *Board, CHESSMOVE *legal_move_list, WORD *next_move, int color)
+template <int color>
+void BBGenerateCastles(BB_BOARD *Board, MOVELIST *mlMoves)
 {
-    assert(legal_move_list);
+    assert(mlMoves);
     IS_COLOR_OK(color);
-    assert(*next_move >= 0 && *next_move <= MAX_LEGAL_MOVES);
+    assert(mlMoves->nNumMoves >= 0 && mlMoves->nNumMoves <= MAX_LEGAL_MOVES);
 
-    int	opp = OPPONENT(color);
+    const int	opp = OPPONENT(color);
     int	castles = Board->castles;
 
     if (color == WHITE)
@@ -257,7 +395,7 @@ void BBGenerateCastles(BB_BOARD *Board, CHESSMOVE *legal_move_list, WORD *next_m
             {
                 // nobody attacking castling squares
                 if ((GetAttackers(Board, BB_F1, opp, TRUE) | (GetAttackers(Board, BB_G1, opp, TRUE))) == 0)
-                    BBAddToMoveList(legal_move_list, next_move, BB_E1, BB_G1, MOVE_OO, 0);
+                    BBAddToMoveList(mlMoves, BB_E1, BB_G1, MOVE_OO, 0);
             }
         }
 
@@ -269,7 +407,7 @@ void BBGenerateCastles(BB_BOARD *Board, CHESSMOVE *legal_move_list, WORD *next_m
             {
                 // nobody attacking castling squares
                 if ((GetAttackers(Board, BB_D1, opp, TRUE) | (GetAttackers(Board, BB_C1, opp, TRUE))) == 0)
-                    BBAddToMoveList(legal_move_list, next_move, BB_E1, BB_C1, MOVE_OOO, 0);
+                    BBAddToMoveList(mlMoves, BB_E1, BB_C1, MOVE_OOO, 0);
             }
         }
     }
@@ -283,7 +421,7 @@ void BBGenerateCastles(BB_BOARD *Board, CHESSMOVE *legal_move_list, WORD *next_m
             {
                 // nobody attacking castling squares
                 if ((GetAttackers(Board, BB_F8, opp, TRUE) | (GetAttackers(Board, BB_G8, opp, TRUE))) == 0)
-                    BBAddToMoveList(legal_move_list, next_move, BB_E8, BB_G8, MOVE_OO, 0);
+                    BBAddToMoveList(mlMoves, BB_E8, BB_G8, MOVE_OO, 0);
             }
         }
 
@@ -295,29 +433,33 @@ void BBGenerateCastles(BB_BOARD *Board, CHESSMOVE *legal_move_list, WORD *next_m
             {
                 // nobody attacking castling squares
                 if ((GetAttackers(Board, BB_D8, opp, TRUE) | (GetAttackers(Board, BB_C8, opp, TRUE))) == 0)
-                    BBAddToMoveList(legal_move_list, next_move, BB_E8, BB_C8, MOVE_OOO, 0);
+                    BBAddToMoveList(mlMoves, BB_E8, BB_C8, MOVE_OOO, 0);
             }
         }
     }
 }
 
 /*========================================================================
-** GeneratePawnMoves -- all moves for pawns, including promotions and en passant
+** GeneratePawnMoves -- all legal moves for pawns, including promotions and
+** en passant, restricted by 'evasions' and 'pinned' as for normal moves
 **========================================================================
 */
-void BBGeneratePawnMoves(BB_BOARD *Board, CHESSMOVE *legal_move_list, WORD *next_move, int color,
-                         BOOL CapturesOnly)
+template <int color>
+void BBGeneratePawnMoves(BB_BOARD *Board, MOVELIST *mlMoves,
+                         int nGenType, Bitboard evasions, Bitboard pinned, int kingsquare)
 {
-    assert(legal_move_list);
+    assert(mlMoves);
     IS_COLOR_OK(color);
-	assert(*next_move >= 0 && *next_move <= MAX_LEGAL_MOVES);
+	assert(mlMoves->nNumMoves >= 0 && mlMoves->nNumMoves <= MAX_LEGAL_MOVES);
 
-    Bitboard		moves, target;
+    Bitboard		moves, target, allowed;
     Bitboard		capture = 0;
     Bitboard		pieces = Board->bbPieces[PAWN][color];
     int				dest;
     int				score = 0;
-    int				opp = OPPONENT(color);
+    const int		opp = OPPONENT(color);
+    const Bitboard	promote = (color == WHITE) ? BB_RANK_8 : BB_RANK_1;
+    const int		ep_dest = (color == WHITE) ? Board->epSquare - 8 : Board->epSquare + 8;
     MoveFlagType	flag;
 
     while (pieces)
@@ -327,15 +469,22 @@ void BBGeneratePawnMoves(BB_BOARD *Board, CHESSMOVE *legal_move_list, WORD *next
 		IS_SQ_OK(square);
         moves = bbPawnMoves[color][square];
 
+        allowed = evasions;
+        if (piece & pinned)
+            allowed &= bbSquaresLine[kingsquare][square];
+
         // mask out moves that capture piece of same color
         moves &= ~Board->bbMaterial[color];
 
         // if captures only, mask out all moves that go forward unless they are promotions
-        if (CapturesOnly)
+        if (nGenType == GEN_CAPTURES)
         {
             moves &= ~FileMask[File(square)];
-            moves |= (bbPawnMoves[color][square] & (BB_RANK_1 | BB_RANK_8));
+            moves |= (bbPawnMoves[color][square] & promote);
         }
+        // if quiets only, the opposite -- forward moves that are not promotions
+        else if (nGenType == GEN_QUIETS)
+            moves &= (FileMask[File(square)] & ~promote);
 
         while (moves)
         {
@@ -352,11 +501,14 @@ void BBGeneratePawnMoves(BB_BOARD *Board, CHESSMOVE *legal_move_list, WORD *next
                 capture = (target & Board->bbMaterial[opp]);
 
                 // if not a normal capture, might be en passant
-                if (!capture && (dest == (color == WHITE ? Board->epSquare - 8 : Board->epSquare + 8)))
+                if (!capture && (dest == ep_dest))
                 {
                     if (PIECEOF(Board->squares[Board->epSquare]) != PAWN)
                         continue;
 
+                    if (!BBEnPassantIsLegal(Board, square, dest, kingsquare, color))
+                        continue;
+
                     flag |= (MOVE_ENPASSANT | MOVE_CAPTURE);
                     score = BBScoreCapture(PAWN, PAWN);
                     capture = TRUE;
@@ -365,6 +517,9 @@ void BBGeneratePawnMoves(BB_BOARD *Board, CHESSMOVE *legal_move_list, WORD *next
                 if (!capture)
                     continue;
 
+                if (((flag & MOVE_ENPASSANT) == 0) && !(target & allowed))
+                    continue;
+
                 if (capture && ((flag & MOVE_ENPASSANT) == 0) && (PIECEOF(Board->squares[dest]) == KING))	// a bit of a hack, as this situation can occur when verifying checkmate
                     continue;
 
@@ -385,140 +540,241 @@ void BBGeneratePawnMoves(BB_BOARD *Board, CHESSMOVE *legal_move_list, WORD *next
                     if (Bit[(dest + square) / 2] & Board->bbOccupancy)
                         continue;
                 }
+
+                if (!(target & allowed))
+                    continue;
             }
 
             // add moves to list, including all promotion moves
-            if (target & (BB_RANK_8 | BB_RANK_1))	// check for promotion
+            if (target & promote)	// check for promotion
             {
                 PieceType	promoted;
 
                 for (promoted = FIRST_PROMOTE; promoted <= LAST_PROMOTE; promoted++)
-                    BBAddToMoveList(legal_move_list, next_move, (SquareType)square, (SquareType)dest, (MoveFlagType)(flag | promoted | MOVE_PROMOTED), score);
+                    BBAddToMoveList(mlMoves, (SquareType)square, (SquareType)dest, (MoveFlagType)(flag | promoted | MOVE_PROMOTED), score);
             }
             else
-                BBAddToMoveList(legal_move_list, next_move, (SquareType)square, (SquareType)dest, flag, score);
+                BBAddToMoveList(mlMoves, (SquareType)square, (SquareType)dest, flag, score);
         }
     }
 }
 
 /*========================================================================
-** GenerateAllMoves -- Generates all moves, verifying that they are legal
-** and also flagging moves that give check
+** GenerateMoveList -- Generates all legal moves, or only the captures and
+** promotions (GEN_CAPTURES) or only the rest (GEN_QUIETS). Checkers and
+** pinned pieces are found once up front, so only en passant needs a
+** separate test. The generators are compiled once for each side to move
 **========================================================================
 */
-void BBGenerateAllMoves(BB_BOARD *Board, CHESSMOVE *legal_move_list, WORD *total_moves, BOOL CapturesOnly)
+template <int color>
+static void BBGenerateMoveListFor(BB_BOARD *Board, MOVELIST *mlMoves, int nGenType)
 {
-    int	x, kingsquare;
-    WORD pseudo_moves = 0;
-    int color = Board->sidetomove;
+    int			kingsquare;
+    Bitboard	checkers, evasions, pinned;
+
+    assert(Board->sidetomove == color);
 
-    *total_moves = 0;
+    mlMoves->nNumMoves = 0;
 
 #if VERIFY_BOARD
     BB_BOARD	BoardTemp;
     memcpy(&BoardTemp, Board, sizeof(BB_BOARD));
 #endif
 
-    BBGenerateNormalMoves(Board, legal_move_list, &pseudo_moves, color, CapturesOnly);
+    kingsquare = BitScan(Board->bbPieces[KING][color]);
+    checkers = GetAttackers(Board, kingsquare, OPPONENT(color), FALSE);
+
+    // when in check, non-king moves must capture the checker or block it, and in double check only the king can move
+    if (checkers == 0)
+        evasions = ~BB_EMPTY;
+    else if (checkers & (checkers - 1))
+        evasions = BB_EMPTY;
+    else
+        evasions = checkers | bbSquaresBetween[kingsquare][BitScan(checkers)];
+
+    pinned = BBGetPinned(Board, kingsquare, color);
+
+    BBGenerateNormalMoves<color>(Board, mlMoves, nGenType, evasions, pinned, kingsquare);
 
 	// castles
-    if (Board->castles && !Board->inCheck && !CapturesOnly)
-        BBGenerateCastles(Board, legal_move_list, &pseudo_moves, color);	// generates legal castles only!
+    if (Board->castles && !checkers && (nGenType != GEN_CAPTURES))
+        BBGenerateCastles<color>(Board, mlMoves);	// generates legal castles only!
 
     if (Board->bbPieces[PAWN][color])
-        BBGeneratePawnMoves(Board, legal_move_list, &pseudo_moves, color, CapturesOnly);
+        BBGeneratePawnMoves<color>(Board, mlMoves, nGenType, evasions, pinned, kingsquare);
+
+#if VERIFY_BOARD
+    assert(memcmp(&BoardTemp, Board, sizeof(BB_BOARD)) == 0);
+#endif
+}
+
+void BBGenerateMoveList(BB_BOARD *Board, MOVELIST *mlMoves, int nGenType)
+{
+    if (Board->sidetomove == WHITE)
+        BBGenerateMoveListFor<WHITE>(Board, mlMoves, nGenType);
+    else
+        BBGenerateMoveListFor<BLACK>(Board, mlMoves, nGenType);
+}
+
+/*========================================================================
+** GenerateAllMoves -- GenerateMoveList for callers outside of the search,
+** which want the moves unpacked into CHESSMOVEs
+**========================================================================
+*/
+void BBGenerateAllMoves(BB_BOARD *Board, CHESSMOVE *legal_move_list, WORD *total_moves, int nGenType)
+{
+    MOVELIST	mlMoves;
+    WORD		n;
+
+    BBGenerateMoveList(Board, &mlMoves, nGenType);
+
+    for (n = 0; n < mlMoves.nNumMoves; n++)
+    {
+        BBUnpackMove(Board, mlMoves.pmMoves[n], &legal_move_list[n]);
+        legal_move_list[n].nScore = mlMoves.nScores[n];
+    }
+
+    *total_moves = mlMoves.nNumMoves;
+}
+
+/*========================================================================
+** BBMoveIsLegal -- Is a move from the hash table or the killer list legal
+** in the current position, including its special move type and promoted
+** piece?
+**========================================================================
+*/
+BOOL BBMoveIsLegal(BB_BOARD *Board, PACKEDMOVE pmMove)
+{
+    int				color = Board->sidetomove;
+    int				opp = OPPONENT(color);
+    int				from = PM_FROM(pmMove), to = PM_TO(pmMove);
+    int				piecetype, kingsquare;
+    Bitboard		moves, checkers, evasions;
+
+    if (from == to)
+        return(FALSE);
 
-    // now verify legality of moves
+    // must move one of our own pieces, and not onto another one
+    if (!(Board->bbMaterial[color] & Bit[from]) || (Board->bbMaterial[color] & Bit[to]))
+        return(FALSE);
+
+    piecetype = PIECEOF(Board->squares[from]);
     kingsquare = BitScan(Board->bbPieces[KING][color]);
 
-    for (x = 0; x < pseudo_moves; x++)
+    // a capture of the king is never in the table, see the hack in GenerateNormalMoves
+    if ((Board->bbMaterial[opp] & Bit[to]) && (PIECEOF(Board->squares[to]) == KING))
+        return(FALSE);
+
+    // castles are rare enough that the generator can check them
+    if (PM_SPECIAL(pmMove) == PM_CASTLE)
     {
-        CHESSMOVE	move;
-        int	from, to, flag;
-        int newkingsquare;
-        int frompiece, topiece;
-
-        move = legal_move_list[x];
-        from = move.fsquare;
-        to = move.tsquare;
-        flag = move.moveflag;
-
-        frompiece = Board->squares[from];
-        topiece = Board->squares[to];
-
-        // adjust the bitboards
-		if (topiece)
-			RemovePiece(Board, to, FALSE);
-		MovePiece(Board, from, to, FALSE);
-
-        // has king moved?
-        if (PIECEOF(frompiece) == KING)
-            newkingsquare = to;
+        MOVELIST	mlCastles;
+        WORD		n;
+
+        if ((piecetype != KING) || !Board->castles || GetAttackers(Board, kingsquare, opp, TRUE))
+            return(FALSE);
+
+        mlCastles.nNumMoves = 0;
+        if (color == WHITE)
+            BBGenerateCastles<WHITE>(Board, &mlCastles);
         else
-            newkingsquare = kingsquare;
-
-        if (flag & MOVE_ENPASSANT)
-            RemovePiece(Board, Board->epSquare, FALSE);
-        else if (flag & MOVE_OO)
-			MovePiece(Board, (color == WHITE ? BB_H1 : BB_H8), (color == WHITE ? BB_F1 : BB_F8), FALSE);
-        else if (flag & MOVE_OOO)
-			MovePiece(Board, (color == WHITE ? BB_A1 : BB_A8), (color == WHITE ? BB_D1 : BB_D8), FALSE);
-        else if (flag & MOVE_PROMOTED)
-        {
-            RemovePiece(Board, to, FALSE);
-            PutPiece(Board, (color == WHITE ? XWHITE | (flag & MOVE_PIECEMASK) : XBLACK | (flag & MOVE_PIECEMASK)), to, FALSE);
-        }
+            BBGenerateCastles<BLACK>(Board, &mlCastles);
 
-        if (GetAttackers(Board, newkingsquare, OPPONENT(color), TRUE))	// move left king in check, so it is illegal
-            legal_move_list[x].moveflag |= MOVE_REJECTED;
-
-        // put the bitboards back
-		MovePiece(Board, to, from, FALSE);
-        if (topiece)
-            PutPiece(Board, topiece, to, FALSE);
-
-        if (flag & MOVE_ENPASSANT)
-            PutPiece(Board, PAWN | (color == WHITE ? XBLACK : XWHITE), Board->epSquare, FALSE);
-        else if (flag & MOVE_OO)
-			MovePiece(Board, (color == WHITE ? BB_F1 : BB_F8), (color == WHITE ? BB_H1 : BB_H8), FALSE);
-        else if (flag & MOVE_OOO)
-			MovePiece(Board, (color == WHITE ? BB_D1 : BB_D8), (color == WHITE ? BB_A1 : BB_A8), FALSE);
-        else if (flag & MOVE_PROMOTED)
+        for (n = 0; n < mlCastles.nNumMoves; n++)
         {
-            RemovePiece(Board, from, FALSE);
-            PutPiece(Board, (color == WHITE ? WHITE_PAWN : BLACK_PAWN), from, FALSE);
+            if (mlCastles.pmMoves[n] == pmMove)
+                return(TRUE);
         }
+        return(FALSE);
     }
 
-#if VERIFY_BOARD
-    assert(memcmp(&BoardTemp, Board, sizeof(BB_BOARD)) == 0);
-#endif
+    if (piecetype == PAWN)
+    {
+        if (!(bbPawnMoves[color][from] & Bit[to]))
+            return(FALSE);
 
-    // now remove all illegal moves
-    WORD next_good_move = 0;
+        if ((to - from) & 1)
+        {
+            if (PM_SPECIAL(pmMove) == PM_ENPASSANT)
+            {
+                if ((to != (color == WHITE ? Board->epSquare - 8 : Board->epSquare + 8)) ||
+                    (PIECEOF(Board->squares[Board->epSquare]) != PAWN))
+                    return(FALSE);
 
-    for (x = 0; x < pseudo_moves; ++x)
-    {
-        if (!(legal_move_list[x].moveflag & MOVE_REJECTED))
+                return(BBEnPassantIsLegal(Board, from, to, kingsquare, color));
+            }
+
+            if (!(Board->bbMaterial[opp] & Bit[to]))
+                return(FALSE);
+        }
+        else
         {
-            if (next_good_move != x)
-                legal_move_list[next_good_move] = legal_move_list[x];
+            if (Bit[to] & Board->bbOccupancy)
+                return(FALSE);
+            if ((abs(to - from) == 16) && (Bit[(to + from) / 2] & Board->bbOccupancy))
+                return(FALSE);
+        }
+
+        // a move to the last rank must be a promotion, and nothing else may be
+        if ((Bit[to] & (BB_RANK_8 | BB_RANK_1)) ? (PM_SPECIAL(pmMove) != PM_PROMOTION) : (PM_SPECIAL(pmMove) != PM_NORMAL))
+            return(FALSE);
+    }
+    else
+    {
+        if (PM_SPECIAL(pmMove) != PM_NORMAL)
+            return(FALSE);
 
-            ++next_good_move;
+        switch (piecetype)
+        {
+            case BISHOP:
+                moves = Bmagic(from, Board->bbOccupancy);
+                break;
+            case ROOK:
+                moves = Rmagic(from, Board->bbOccupancy);
+                break;
+            case QUEEN:
+                moves = Qmagic(from, Board->bbOccupancy);
+                break;
+            case KNIGHT:
+                moves = bbKnightMoves[from];
+                break;
+            default:	// KING
+                moves = bbKingMoves[from];
+                break;
         }
+
+        if (!(moves & Bit[to]))
+            return(FALSE);
+
+        if (piecetype == KING)
+            return(!BBSquareAttacked(Board, to, opp, Board->bbOccupancy ^ Bit[from]));
+    }
+
+    // when in check, the move must capture the checker or block it
+    checkers = GetAttackers(Board, kingsquare, opp, FALSE);
+    if (checkers)
+    {
+        if (checkers & (checkers - 1))
+            return(FALSE);
+        evasions = checkers | bbSquaresBetween[kingsquare][BitScan(checkers)];
+        if (!(evasions & Bit[to]))
+            return(FALSE);
     }
 
-    *total_moves = next_good_move;
+    // and a pinned piece must stay on the pin line
+    if ((BBGetPinned(Board, kingsquare, color) & Bit[from]) && !(bbSquaresLine[kingsquare][from] & Bit[to]))
+        return(FALSE);
+
+    return(TRUE);
 }
 
 /*========================================================================
-** UpdateCastleStatus - Called after every makemove if any castles are legal
+** BBCastleStatusAfter - castle status after a move from/to the given
+** squares, without changing the board
 **========================================================================
 */
-void BBUpdateCastleStatus(BB_BOARD *Board, SquareType from, SquareType to)
+static inline int BBCastleStatusAfter(int castles, SquareType from, SquareType to)
 {
-    int	castles = Board->castles;
-
     if (from == BB_E1)
         castles &= ~(WHITE_QUEENSIDE_BIT | WHITE_KINGSIDE_BIT);
     if (from == BB_E8)
@@ -548,14 +804,91 @@ void BBUpdateCastleStatus(BB_BOARD *Board, SquareType from, SquareType to)
             castles &= ~BLACK_KINGSIDE_BIT;
     }
 
-    Board->castles = castles;
+    return(castles);
 }
 
 /*========================================================================
-** MakeMove - makes move and returns captured piece if any
+** UpdateCastleStatus - Called after every makemove if any castles are legal
 **========================================================================
 */
-void BBMakeMove(CHESSMOVE* move_to_make, BB_BOARD* Board, BOOL bUpdateAcc)
+void BBUpdateCastleStatus(BB_BOARD *Board, SquareType from, SquareType to)
+{
+    Board->castles = BBCastleStatusAfter(Board->castles, from, to);
+}
+
+/*========================================================================
+** BBGetMoveSignature - returns the signature of the position after the
+** move, without making it, so the search can prefetch the child's hash
+** entries -- must match the signature updates in BBMakeMove
+**========================================================================
+*/
+PosSignature BBGetMoveSignature(BB_BOARD *Board, CHESSMOVE *move)
+{
+    PosSignature	dwSignature = Board->signature;
+    MoveFlagType	moveflag = move->moveflag;
+    SquareType		from = move->fsquare;
+    SquareType		to = move->tsquare;
+    int      		moving_piece = Board->squares[from];
+    int				captured_piece = Board->squares[to];
+    BYTE			pIndex = PIECEOF(moving_piece);
+
+    if (COLOROF(moving_piece) == XBLACK)
+        pIndex += 6;
+
+    dwSignature ^= aPArray[pIndex][from];
+    if (moveflag & MOVE_PROMOTED)
+        dwSignature ^= aPArray[(pIndex - PAWN) + (moveflag & MOVE_PIECEMASK)][to];
+    else
+        dwSignature ^= aPArray[pIndex][to];
+
+    if (captured_piece != EMPTY)
+    {
+        pIndex = PIECEOF(captured_piece);
+        if (COLOROF(captured_piece) == XBLACK)
+            pIndex += 6;
+        dwSignature ^= aPArray[pIndex][to];
+    }
+    else if (moveflag & MOVE_ENPASSANT)
+    {
+        pIndex = PAWN;
+        if (COLOROF(moving_piece) == XWHITE)
+            pIndex += 6;
+        dwSignature ^= aPArray[pIndex][Board->epSquare];
+    }
+
+    if (Board->epSquare != NO_EN_PASSANT)
+        dwSignature ^= aEPArray[Board->epSquare];
+    if ((PIECEOF(moving_piece) == PAWN) && (abs(from - to) == 16))
+        dwSignature ^= aEPArray[to];
+
+    dwSignature ^= aSTMArray[WHITE];
+    dwSignature ^= aSTMArray[BLACK];
+
+    if (PIECEOF(moving_piece) == KING)
+    {
+        pIndex = ROOK;
+        if (COLOROF(moving_piece) == XBLACK)
+            pIndex += 6;
+
+        if (moveflag & MOVE_OO)
+            dwSignature ^= aPArray[pIndex][to + 1] ^ aPArray[pIndex][from + 1];
+        else if (moveflag & MOVE_OOO)
+            dwSignature ^= aPArray[pIndex][to - 2] ^ aPArray[pIndex][from - 1];
+    }
+
+    if (Board->castles)
+        dwSignature ^= aCSArray[Board->castles] ^ aCSArray[BBCastleStatusAfter(Board->castles, from, to)];
+
+    return(dwSignature);
+}
+
+/*========================================================================
+** MakeMove - makes move and returns captured piece if any, compiled once
+** for each side to move
+**========================================================================
+*/
+template <int color>
+static void BBMakeMoveFor(CHESSMOVE* move_to_make, BB_BOARD* Board, BOOL bUpdateAcc)
 {
     assert(move_to_make);
     assert(Board);
@@ -568,12 +901,17 @@ void BBMakeMove(CHESSMOVE* move_to_make, BB_BOARD* Board, BOOL bUpdateAcc)
     SquareType		to = move_to_make->tsquare;
     int      		moving_piece = Board->squares[from];
     int				captured_piece = Board->squares[to];
-    ColorType		my_color = COLOROF(moving_piece);
+    const ColorType	my_color = (color == WHITE) ? XWHITE : XBLACK;
 
+    assert(COLOROF(moving_piece) == my_color);
     assert(from != to);
     IS_SQ_OK(from);
     IS_SQ_OK(to);
 
+#if VERIFY_BOARD
+    PosSignature	dwPredicted = BBGetMoveSignature(Board, move_to_make);
+#endif
+
     // save board information for unmaking move
     save_undo = &move_to_make->save_undo;
 
@@ -589,6 +927,16 @@ void BBMakeMove(CHESSMOVE* move_to_make, BB_BOARD* Board, BOOL bUpdateAcc)
 	bUpdateAcc = FALSE;
 #endif
 
+#if USE_LAZY_ACC_UPDATE
+	if (bUpdateAcc == ACC_LAZY)
+	{
+		assert(Board == pAccBoard);
+		pAccTop++;
+		pAccTop->bComputed = FALSE;
+		pAccTop->nDel = pAccTop->nAdd = 0;
+	}
+#endif
+
     // fix the board signature -- other fixes may be necessary later in this function
     dwSignature = save_undo->dwSignature;
 
@@ -605,7 +953,7 @@ void BBMakeMove(CHESSMOVE* move_to_make, BB_BOARD* Board, BOOL bUpdateAcc)
     if (captured_piece != EMPTY)
     {
         pToIndex = PIECEOF(captured_piece);
-        if (COLOROF(captured_piece) == XBLACK)
+        if (my_color == XWHITE)	// always the opponent's piece
             pToIndex += 6;
         assert(pToIndex >= 0 && pToIndex < 12);
         dwSignature ^= aPArray[pToIndex][to];
@@ -708,25 +1056,36 @@ void BBMakeMove(CHESSMOVE* move_to_make, BB_BOARD* Board, BOOL bUpdateAcc)
         PutPiece(Board, my_color | (moveflag & MOVE_PIECEMASK), to, bUpdateAcc);
     }
 
-    Board->inCheck = BBKingInDanger(Board, OPPONENT(Board->sidetomove));
+    Board->inCheck = BBKingInDanger(Board, OPPONENT(color));
     if (Board->inCheck)
         move_to_make->moveflag |= MOVE_CHECK;
 
-    Board->sidetomove = OPPONENT(Board->sidetomove);
+    Board->sidetomove = OPPONENT(color);
 
     Board->signature = dwSignature;
 
 #if VERIFY_BOARD
     assert(Board->signature == GetBBSignature(Board));
+    assert(Board->signature == dwPredicted);
 	assert(VerifyWood(Board));
 #endif
 }
 
+void BBMakeMove(CHESSMOVE* move_to_make, BB_BOARD* Board, BOOL bUpdateAcc)
+{
+    if (Board->sidetomove == WHITE)
+        BBMakeMoveFor<WHITE>(move_to_make, Board, bUpdateAcc);
+    else
+        BBMakeMoveFor<BLACK>(move_to_make, Board, bUpdateAcc);
+}
+
 /*========================================================================
-** eUnMakeMove - Takes back a move from a board
+** eUnMakeMove - Takes back a move from a board, compiled once for each
+** side that made the move
 **========================================================================
 */
-void BBUnMakeMove(CHESSMOVE *move_to_unmake, BB_BOARD *Board, BOOL bUpdateAcc)
+template <int color>
+static void BBUnMakeMoveFor(CHESSMOVE *move_to_unmake, BB_BOARD *Board, BOOL bUpdateAcc)
 {
 	assert(move_to_unmake);
     assert(Board);
@@ -734,12 +1093,24 @@ void BBUnMakeMove(CHESSMOVE *move_to_unmake, BB_BOARD *Board, BOOL bUpdateAcc)
     PUNDOMOVE 	save_undo;
     SquareType  from = move_to_unmake->fsquare;
     SquareType	to = move_to_unmake->tsquare;
-    ColorType   which_color = COLOROF(Board->squares[to]);
+    const ColorType	which_color = (color == WHITE) ? XWHITE : XBLACK;
+
+    assert(COLOROF(Board->squares[to]) == which_color);
 
 #if !USE_INCREMENTAL_ACC_UPDATE
 	bUpdateAcc = FALSE;
 #endif
 
+#if USE_LAZY_ACC_UPDATE
+	// the accumulator below on the stack is still the one from before the move
+	if (bUpdateAcc == ACC_LAZY)
+	{
+		assert(Board == pAccBoard);
+		pAccTop--;
+		bUpdateAcc = FALSE;
+	}
+#endif
+
 	save_undo = &move_to_unmake->save_undo;
 
 	MovePiece(Board, to, from, bUpdateAcc);
@@ -760,25 +1131,33 @@ void BBUnMakeMove(CHESSMOVE *move_to_unmake, BB_BOARD *Board, BOOL bUpdateAcc)
 
     if (move_to_unmake->moveflag & MOVE_OO)
     {
-        if (COLOROF(Board->squares[from]) == XWHITE)
+        if (color == WHITE)
 			MovePiece(Board, BB_F1, BB_H1, bUpdateAcc);
         else
 			MovePiece(Board, BB_F8, BB_H8, bUpdateAcc);
     }
     else if (move_to_unmake->moveflag & MOVE_OOO)
     {
-        if (COLOROF(Board->squares[from]) == XWHITE)
+        if (color == WHITE)
 			MovePiece(Board, BB_D1, BB_A1, bUpdateAcc);
         else
 			MovePiece(Board, BB_D8, BB_A8, bUpdateAcc);
     }
 
-    Board->sidetomove = OPPONENT(Board->sidetomove);
+    Board->sidetomove = color;
 #if VERIFY_BOARD
 	assert(VerifyWood(Board));
 #endif
 }
 
+void BBUnMakeMove(CHESSMOVE *move_to_unmake, BB_BOARD *Board, BOOL bUpdateAcc)
+{
+    if (Board->sidetomove == BLACK)	// white made the move
+        BBUnMakeMoveFor<WHITE>(move_to_unmake, Board, bUpdateAcc);
+    else
+        BBUnMakeMoveFor<BLACK>(move_to_unmake, Board, bUpdateAcc);
+}
+
 /*========================================================================
 ** MakeNullMove - makes null move
 **========================================================================
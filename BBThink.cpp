@@ -17,6 +17,8 @@ along with this program.If not, see < https://www.gnu.org/licenses/>.
 */
 
 #include <math.h>
+#include <thread>
+#include <atomic>
 #include "Myrddin.h"
 #include "Bitboards.h"
 #include "MoveGen.h"
@@ -35,24 +37,58 @@ along with this program.If not, see < https://www.gnu.org/licenses/>.
 #define USE_QS_RECAPTURE	FALSE
 #define QS_FULL_DEPTH		4		// if USE_QS_RECAPTURE is TRUE, number of plies in qsearch to fully check after which check only recaptures (and promotions)
 
-unsigned long long  nSearchNodes, nQNodes;
+#if USE_SMALL_NET
+#define SMALL_NET_QS_DEPTH	2		// qsearch plies evaluated with the big network, deeper ones use the small network
+#define SMALL_NET_CLOCK		10000	// with less than this on the clock (milliseconds), the small network evaluates everything
+#define SMALL_NET_ROOT_PLY	2		// ...but the first plies
+#endif
+
+// everything touched by the search is per thread, so that Lazy SMP helper threads can search the same root independently
+thread_local unsigned long long  nSearchNodes, nQNodes;
+thread_local int	nEvalPly, nEvalMove;
+thread_local int	nQuiesceDepth;
+#if USE_SMALL_NET
+static thread_local BOOL	bShortOfTime;
+#endif
+thread_local int	nPrevEval, nCurEval;
+thread_local PV		evalPV, prevDepthPV;
+thread_local BOOL	bKeepThinking, bIsNullOk, bThinkUntilSafe;
+thread_local int	nThreadNum = 0;	// 0 is the main thread, which handles input, time and output
 unsigned long long  nPerftMoves;
-int		nEvalPly, nEvalMove;
-int		nQuiesceDepth;
-int		nPrevEval, nCurEval;
-PV		evalPV, prevDepthPV;
-BOOL	bKeepThinking, bIsNullOk, bThinkUntilSafe;
 const int		nPieceVals[NPIECES] = { KING_VAL, QUEEN_VAL, ROOK_VAL, MINOR_VAL, MINOR_VAL, PAWN_VAL };  // only used for SEE and move ordering
 
 int LMRReductions[32][32];
 
 #if USE_IMPROVING
-int nEvalStack[MAX_DEPTH + 10];
+thread_local int nEvalStack[MAX_DEPTH + 10];
+#endif
+
+thread_local BB_BOARD	bbEvalBoard;
+
+// the search only records the accumulator changes of its moves on the accumulator stack
+#if USE_LAZY_ACC_UPDATE
+#define ACC_SEARCH	ACC_LAZY
+#else
+#define ACC_SEARCH	TRUE
 #endif
 
-BB_BOARD	bbEvalBoard;
+thread_local CHESSMOVE	cmEvalGameMoveList[MAX_MOVE_LIST];
+
+#if USE_SMP
+typedef struct alignas(64)	// keep each helper's node counter on its own cache line
+{
+	std::thread		thread;
+	std::atomic<unsigned long long>	nSearchNodes;
+} SMP_THREAD;
 
-CHESSMOVE	cmEvalGameMoveList[MAX_MOVE_LIST];
+static SMP_THREAD	smpThreads[MAX_CPUS];
+static std::atomic<BOOL>	bStopHelpers(FALSE);
+
+// snapshot of the game at the start of the search, so the helpers never read the game board while the main thread changes it
+static BB_BOARD		bbSMPRoot;
+static CHESSMOVE	cmSMPRootMoveList[MAX_MOVE_LIST];
+static int			nSMPRootMove;
+#endif
 
 // total time on dev machine with bulk counting = 49.3s (45.7 if not using incremental accumulator update)
 PERFT_TEST	perft_tests[NUM_PERFT_TESTS] =
@@ -72,13 +108,48 @@ PERFT_TEST	perft_tests[NUM_PERFT_TESTS] =
 };
 
 #if USE_KILLERS
-static KILLER		cmKillers[MAX_DEPTH + 2][MAX_KILLERS];
+static thread_local KILLER		cmKillers[MAX_DEPTH + 2][MAX_KILLERS];
 #endif
 
 #if USE_HISTORY
-static int	cmHistory[64][64];
+static thread_local int	cmHistory[64][64];
 #endif
 
+// move picker stages -- moves are only generated when the stage before them has failed to produce a cutoff
+#define PICK_HASH			0
+#define PICK_GEN_CAPTURES	1
+#define PICK_CAPTURES		2
+#define PICK_KILLERS		3
+#define PICK_GEN_QUIETS		4
+#define PICK_QUIETS			5
+#define PICK_EVASIONS		6	// in check, all moves are generated at once
+#define PICK_DONE			7
+
+// the order in which to search the moves of a stage, as indices into the
+// move list -- MAX_LEGAL_MOVES is less than 256. Only these one byte indices
+// are sorted, the moves and their scores stay where the generator put them
+typedef BYTE MOVE_ORDER;
+
+typedef struct
+{
+	int			nStage;
+	BOOL		bQuiesce;		// captures only when not in check, and no hash move, killers or history
+	PACKEDMOVE	pmHash;			// legal hash move, NO_PACKEDMOVE if there is none
+	int			nKiller;
+	WORD		nNext;			// moves already picked from the current stage
+	MOVE_ORDER	moOrder[MAX_LEGAL_MOVES];
+	MOVELIST	mlMoves;		// moves in the current stage
+} MOVE_PICKER;
+
+// BBAlphaBeta() and BBQuiesce() are compiled once per kind of node, so that the
+// null window nodes, nearly all of them, carry none of the root's or PV's work
+typedef enum
+{
+	NODE_ROOT,		// nEvalPly == 0, the searches started by Think()
+	NODE_PV,		// full window, which may still be narrowed to a null window on the way
+	NODE_NONPV		// null window, always
+} NODE_TYPE;
+
 /*========================================================================
 ** doBBPerft - calculates the number of leaf nodes of a given depth from
 ** the current board position
@@ -89,14 +160,16 @@ unsigned long long doBBPerft(int depth, BB_BOARD* Board, BOOL bDivide)
 	int			nMove;
 	unsigned long long nodes = 0;
 	WORD		nNumMoves;
-	CHESSMOVE	cmPerftMoveList[MAX_LEGAL_MOVES];
+	MOVELIST	mlPerftMoveList;
+	CHESSMOVE	cmPerftMove;
 
 #if !USE_BULK_COUNTING
 	if (depth == 0)
 		return(1);
 #endif
 
-	BBGenerateAllMoves(Board, cmPerftMoveList, &nNumMoves, FALSE);
+	BBGenerateMoveList(Board, &mlPerftMoveList, GEN_ALL);
+	nNumMoves = mlPerftMoveList.nNumMoves;
 
 #if USE_BULK_COUNTING
 	if (depth == 1)
@@ -109,10 +182,12 @@ unsigned long long doBBPerft(int depth, BB_BOARD* Board, BOOL bDivide)
 
 		char	buf1[16], buf2[16];
 
+		BBUnpackMove(Board, mlPerftMoveList.pmMoves[nMove], &cmPerftMove);
+
 		if ((depth > 1) && bDivide)
 		{
-			BBSquareName(cmPerftMoveList[nMove].fsquare, buf1);
-			BBSquareName(cmPerftMoveList[nMove].tsquare, buf2);
+			BBSquareName(cmPerftMove.fsquare, buf1);
+			BBSquareName(cmPerftMove.tsquare, buf2);
 			printf("    %s to %s ", buf1, buf2);
 		}
 
@@ -121,7 +196,7 @@ unsigned long long doBBPerft(int depth, BB_BOARD* Board, BOOL bDivide)
 		memcpy(&BoardTemp, Board, sizeof(BB_BOARD));
 #endif
 
-		BBMakeMove(&cmPerftMoveList[nMove], Board, FALSE);
+		BBMakeMove(&cmPerftMove, Board, FALSE);
 
 		tempnodes = doBBPerft(depth - 1, Board, FALSE);
 
@@ -129,7 +204,7 @@ unsigned long long doBBPerft(int depth, BB_BOARD* Board, BOOL bDivide)
 			printf("= %I64u nodes\n", tempnodes);
 		nodes += tempnodes;
 
-		BBUnMakeMove(&cmPerftMoveList[nMove], Board, FALSE);
+		BBUnMakeMove(&cmPerftMove, Board, FALSE);
 
 #if VERIFY_BOARD
 		assert(memcmp(&BoardTemp, Board, sizeof(BB_BOARD)) == 0);
@@ -167,11 +242,6 @@ static inline BOOL EvalPositionRepeated(PosSignature dwSignature)
 */
 static inline BOOL CheckTimeRemaining(void)
 {
-#if USE_SMP
-	if (bSlave)
-		return(TRUE);
-#endif
-
 	BOOL		    bTimeRemaining;
 	int			    nEvalDip;
 
@@ -191,7 +261,7 @@ static inline BOOL CheckTimeRemaining(void)
 	}
 
 	if (bExactThinkNodes)
-		return(nThinkNodes > nSearchNodes);
+		return(nThinkNodes > GetSMPNodes());
 
 	if (bExactThinkDepth)
 		return(TRUE);
@@ -272,7 +342,67 @@ static inline BOOL CheckTimeRemaining(void)
 }
 
 /*========================================================================
-** GetNextMove - finds the move with the highest score in the move list
+** UseSmallNet - TRUE if the small network should evaluate the node
+** nPlies below the current one: deep in qsearch, or anywhere but near
+** the root when short of time
+**========================================================================
+*/
+static inline BOOL UseSmallNet(int nPlies)
+{
+#if USE_SMALL_NET
+	if (!bSmallNet)
+		return(FALSE);
+
+	if (bShortOfTime)
+		return(nEvalPly + nPlies >= SMALL_NET_ROOT_PLY);
+
+	return(nQuiesceDepth + nPlies >= SMALL_NET_QS_DEPTH);
+#else
+	return(FALSE);
+#endif
+}
+
+/*========================================================================
+** SearchAborted - TRUE if the current search has to unwind. The main
+** thread follows the engine command, the helpers stop when told to.
+**========================================================================
+*/
+static inline BOOL SearchAborted(void)
+{
+#if USE_SMP
+	if (nThreadNum)
+		return(bStopHelpers);
+#endif
+
+	return((nEngineCommand == END_THINKING) || (nEngineCommand == STOP_THINKING));
+}
+
+/*========================================================================
+** CheckForInterrupt - called every nCheckNodes nodes. The main thread
+** handles input and time, the helpers publish their node counts.
+**========================================================================
+*/
+static inline void CheckForInterrupt(void)
+{
+#if USE_SMP
+	if (nThreadNum)
+	{
+		smpThreads[nThreadNum].nSearchNodes = nSearchNodes;
+		return;
+	}
+#endif
+
+	if (CheckForInput(FALSE))
+		HandleCommand();
+
+	if ((CheckTimeRemaining() == FALSE) && (nEngineCommand != STOP_THINKING))	// a command might tell us to stop
+		nEngineCommand = END_THINKING;
+}
+
+/*========================================================================
+** GetNextMove - finds the move with the highest score in the move list.
+** No longer used by the search, which uses PickMove() instead, but
+** kept for comparison by SortBenchmark()
 **========================================================================
 */
 static inline CHESSMOVE* GetNextMove(CHESSMOVE* MoveList, int nNumMoves)
@@ -310,62 +440,65 @@ static inline CHESSMOVE* GetNextMove(CHESSMOVE* MoveList, int nNumMoves)
 ** heuristics
 **========================================================================
 */
-static inline void ScoreMoves(CHESSMOVE* MoveList, int nNumMoves)
+static inline void ScoreMoves(MOVELIST* mlMoves)
 {
 	int	n;
-	CHESSMOVE cmMove;
+	PACKEDMOVE pmMove;
 
-	for (n = 0; n < nNumMoves; n++)
+	for (n = 0; n < mlMoves->nNumMoves; n++)
 	{
-		cmMove = MoveList[n];
+		pmMove = mlMoves->pmMoves[n];
+
+#if USE_KILLERS
+		int	nGenScore = mlMoves->nScores[n];
+#endif
 
 #if USE_HISTORY
-		MoveList[n].nScore += cmHistory[cmMove.fsquare][cmMove.tsquare];	// update from the history array
+		mlMoves->nScores[n] += cmHistory[PM_FROM(pmMove)][PM_TO(pmMove)];	// update from the history array
 #endif
 
 #if USE_SEE_MOVE_ORDER
-		if (cmMove.moveflag & MOVE_CAPTURE)
-			cmMove.nScore = MoveList[n].nScore += BBSEEMove(&cmMove, nSideToMove);
+		if (bbEvalBoard.bbOccupancy & Bit[PM_TO(pmMove)])
+		{
+			CHESSMOVE cmMove;
+
+			BBUnpackMove(&bbEvalBoard, pmMove, &cmMove);
+			mlMoves->nScores[n] += BBSEEMove(&cmMove, nSideToMove);
+		}
 #endif
 
 #if USE_KILLERS
-		if (cmMove.nScore >= KILLER_1_SORT_VAL)
+		if (nGenScore >= KILLER_1_SORT_VAL)
 			continue;
 
 		// update scores based on killers array
-		if ((cmMove.fsquare == cmKillers[nEvalPly][0].cmKiller.fsquare) &&
-			(cmMove.tsquare == cmKillers[nEvalPly][0].cmKiller.tsquare) /* &&
-			(cmMove.moveflag == cmKillers[nEvalPly][0].cmKiller.moveflag) */)
+		if (PM_SQUARES(pmMove) == PM_SQUARES(cmKillers[nEvalPly][0].pmKiller))
 		{
-			MoveList[n].nScore = KILLER_1_SORT_VAL;
+			mlMoves->nScores[n] = KILLER_1_SORT_VAL;
 #if 0
 			if (abs(cmKillers[nEvalPly][0].nEval) > (CHECKMATE / 2))
-				MoveList[n].nScore += MATE_KILLER_BONUS;
+				mlMoves->nScores[n] += MATE_KILLER_BONUS;
 #endif
 		}
 
 #if (MAX_KILLERS > 1)
-		if ((cmMove.fsquare == cmKillers[nEvalPly][1].cmKiller.fsquare) &&
-			(cmMove.tsquare == cmKillers[nEvalPly][1].cmKiller.tsquare) /* &&
-			(cmMove.moveflag == cmKillers[nEvalPly][1].cmKiller.moveflag) */)
+		if (PM_SQUARES(pmMove) == PM_SQUARES(cmKillers[nEvalPly][1].pmKiller))
 		{
-			MoveList[n].nScore = KILLER_2_SORT_VAL;
+			mlMoves->nScores[n] = KILLER_2_SORT_VAL;
 #if 0
 			if (abs(cmKillers[nEvalPly][1].nEval) > (CHECKMATE / 2))
-				MoveList[n].nScore += MATE_KILLER_BONUS;
+				mlMoves->nScores[n] += MATE_KILLER_BONUS;
 #endif
 		}
 #endif
 
 #if (MAX_KILLERS > 2)
-		if ((cmMove.fsquare == cmKillers[nEvalPly][2].cmKiller.fsquare) &&
-			(cmMove.tsquare == cmKillers[nEvalPly][2].cmKiller.tsquare) /* &&
-			(cmMove.moveflag == cmKillers[nEvalPly][2].cmKiller.moveflag) */)
+		if (PM_SQUARES(pmMove) == PM_SQUARES(cmKillers[nEvalPly][2].pmKiller))
 		{
-			MoveList[n].nScore = KILLER_3_SORT_VAL;
+			mlMoves->nScores[n] = KILLER_3_SORT_VAL;
 #if 0
 			if (abs(cmKillers[nEvalPly][2].nEval) > (CHECKMATE / 2))
-				MoveList[n].nScore += MATE_KILLER_BONUS;
+				mlMoves->nScores[n] += MATE_KILLER_BONUS;
 #endif
 		}
 #endif
@@ -373,6 +506,495 @@ static inline void ScoreMoves(CHESSMOVE* MoveList, int nNumMoves)
 	}
 }
 
+/*========================================================================
+** SortMoves - sorts the indices of a move list by score, highest first.
+** The insertion sort is stable, so moves with equal scores stay in
+** generation order just as with GetNextMove(), and the many quiet moves
+** with no history score cost almost nothing
+**========================================================================
+*/
+static inline void SortMoves(MOVE_ORDER* moOrder, MOVELIST* mlMoves)
+{
+	int		n, m, nScore;
+	int*	nScores = mlMoves->nScores;
+
+	for (n = 0; n < mlMoves->nNumMoves; n++)
+	{
+		nScore = nScores[n];
+
+		for (m = n; (m > 0) && (nScores[moOrder[m - 1]] < nScore); m--)
+			moOrder[m] = moOrder[m - 1];
+
+		moOrder[m] = (MOVE_ORDER)n;
+	}
+}
+
+/*========================================================================
+** PickMove - returns the index of the next move of a list in score order.
+** The first one is found with a single scan, since most nodes that cut
+** off do so on it, and the list is only sorted once a second move is
+** needed
+**========================================================================
+*/
+static inline int PickMove(MOVE_ORDER* moOrder, MOVELIST* mlMoves, WORD* nNext)
+{
+	int	n, nBest = 0;
+	int	nBestScore = mlMoves->nScores[0];
+
+	assert(*nNext < mlMoves->nNumMoves);
+
+	if (*nNext == 0)
+	{
+		for (n = 1; n < mlMoves->nNumMoves; n++)
+		{
+			if (mlMoves->nScores[n] > nBestScore)
+			{
+				nBest = n;
+				nBestScore = mlMoves->nScores[n];
+			}
+		}
+
+		*nNext = 1;
+		return(nBest);
+	}
+
+	// the sort puts the same move first, as it's stable
+	if (*nNext == 1)
+		SortMoves(moOrder, mlMoves);
+
+	return(moOrder[(*nNext)++]);
+}
+
+/*========================================================================
+** InitMovePicker - set up the stages for a node. 'pmHash' is a move to
+** try first (from the hash table or IID) and must already be legal, or
+** NO_PACKEDMOVE. When in check all of the evasions are generated right
+** away, so mlMoves.nNumMoves is the number of legal moves in that case
+**========================================================================
+*/
+static void InitMovePicker(MOVE_PICKER* mp, PACKEDMOVE pmHash, BOOL bInCheck, BOOL bQuiesce)
+{
+	WORD	n;
+
+	mp->bQuiesce = bQuiesce;
+	mp->nNext = mp->mlMoves.nNumMoves = 0;
+	mp->nKiller = 0;
+	mp->pmHash = pmHash;
+
+	if (bInCheck)
+	{
+		BBGenerateMoveList(&bbEvalBoard, &mp->mlMoves, GEN_ALL);
+
+		if (!bQuiesce)
+		{
+			for (n = 0; n < mp->mlMoves.nNumMoves; n++)
+			{
+				if (mp->mlMoves.pmMoves[n] == mp->pmHash)
+				{
+					mp->mlMoves.nScores[n] += HASH_SORT_VAL;
+					break;
+				}
+			}
+
+			ScoreMoves(&mp->mlMoves);
+		}
+
+		mp->nStage = PICK_EVASIONS;
+	}
+	else if (bQuiesce)
+		mp->nStage = PICK_GEN_CAPTURES;
+	else
+		mp->nStage = PICK_HASH;
+}
+
+/*========================================================================
+** NextMove - returns the next move to search and its score, or
+** NO_PACKEDMOVE when there are no more. Each stage falls through to the
+** next when it runs out of moves
+**========================================================================
+*/
+static PACKEDMOVE NextMove(MOVE_PICKER* mp, int* nScore)
+{
+	PACKEDMOVE	pmMove;
+	int			nMove;
+
+	switch (mp->nStage)
+	{
+		case PICK_HASH:
+			mp->nStage = PICK_GEN_CAPTURES;
+			if (mp->pmHash != NO_PACKEDMOVE)
+			{
+				*nScore = HASH_SORT_VAL;
+				return(mp->pmHash);
+			}
+			// fall through
+
+		case PICK_GEN_CAPTURES:
+			BBGenerateMoveList(&bbEvalBoard, &mp->mlMoves, GEN_CAPTURES);
+			if (!mp->bQuiesce)
+				ScoreMoves(&mp->mlMoves);
+			mp->nNext = 0;
+			mp->nStage = PICK_CAPTURES;
+			// fall through
+
+		case PICK_CAPTURES:
+			while (mp->nNext < mp->mlMoves.nNumMoves)
+			{
+				nMove = PickMove(mp->moOrder, &mp->mlMoves, &mp->nNext);
+				if (mp->mlMoves.pmMoves[nMove] != mp->pmHash)
+				{
+					*nScore = mp->mlMoves.nScores[nMove];
+					return(mp->mlMoves.pmMoves[nMove]);
+				}
+			}
+
+			if (mp->bQuiesce)
+			{
+				mp->nStage = PICK_DONE;
+				return(NO_PACKEDMOVE);
+			}
+			mp->nStage = PICK_KILLERS;
+			// fall through
+
+		case PICK_KILLERS:
+#if USE_KILLERS
+			while (mp->nKiller < MAX_KILLERS)
+			{
+				pmMove = cmKillers[nEvalPly][mp->nKiller].pmKiller;
+				mp->nKiller++;
+
+				// killers are quiet moves, so one that is now a capture has already been tried
+				if ((pmMove == mp->pmHash) || !BBMoveIsLegal(&bbEvalBoard, pmMove) ||
+					(bbEvalBoard.bbOccupancy & Bit[PM_TO(pmMove)]))
+					continue;
+
+				*nScore = KILLER_1_SORT_VAL - (mp->nKiller - 1);	// KILLER_1_SORT_VAL, KILLER_2_SORT_VAL, ...
+				return(pmMove);
+			}
+#endif
+			mp->nStage = PICK_GEN_QUIETS;
+			// fall through
+
+		case PICK_GEN_QUIETS:
+			BBGenerateMoveList(&bbEvalBoard, &mp->mlMoves, GEN_QUIETS);
+			ScoreMoves(&mp->mlMoves);
+			mp->nNext = 0;
+			mp->nStage = PICK_QUIETS;
+			// fall through
+
+		case PICK_QUIETS:
+			while (mp->nNext < mp->mlMoves.nNumMoves)
+			{
+				nMove = PickMove(mp->moOrder, &mp->mlMoves, &mp->nNext);
+
+				// skip the hash move and the killers, which were scored as such by ScoreMoves()
+				if ((mp->mlMoves.pmMoves[nMove] != mp->pmHash) && (mp->mlMoves.nScores[nMove] < KILLER_3_SORT_VAL))
+				{
+					*nScore = mp->mlMoves.nScores[nMove];
+					return(mp->mlMoves.pmMoves[nMove]);
+				}
+			}
+			mp->nStage = PICK_DONE;
+			return(NO_PACKEDMOVE);
+
+		case PICK_EVASIONS:
+			if (mp->nNext < mp->mlMoves.nNumMoves)
+			{
+				nMove = PickMove(mp->moOrder, &mp->mlMoves, &mp->nNext);
+				*nScore = mp->mlMoves.nScores[nMove];
+				return(mp->mlMoves.pmMoves[nMove]);
+			}
+			mp->nStage = PICK_DONE;
+			return(NO_PACKEDMOVE);
+	}
+
+	return(NO_PACKEDMOVE);
+}
+
+/*========================================================================
+** SortBenchmark - times move selection with GetNextMove() against
+** PickMove() on the perft test positions, when searching all of the moves
+** (an all-node) and only the first one (a cut-node)
+**========================================================================
+*/
+void SortBenchmark(int nIterations)
+{
+	static CHESSMOVE	cmMoves[NUM_PERFT_TESTS][MAX_LEGAL_MOVES];
+	static MOVELIST		mlMoves[NUM_PERFT_TESTS];
+	BB_BOARD	Board;
+	CHESSMOVE	cmList[MAX_LEGAL_MOVES];
+	MOVE_ORDER	moOrder[MAX_LEGAL_MOVES];
+	WORD		nNumMoves[NUM_PERFT_TESTS];
+	int			x, n, nIter, nPicks, nTest, nTotalMoves = 0;
+	WORD		nNext;
+	ULONGLONG	starttime, nTime[3];
+	volatile unsigned int nCheck = 0;	// so the picks can't be optimized away
+
+	for (x = 0; x < NUM_PERFT_TESTS; x++)
+	{
+		BBForsytheToBoard(perft_tests[x].fen, &Board);
+		BBGenerateAllMoves(&Board, cmMoves[x], &nNumMoves[x], GEN_ALL);
+		nTotalMoves += nNumMoves[x];
+
+		// give about half of the quiet moves a made-up history score, as in the search
+		for (n = 0; n < nNumMoves[x]; n++)
+		{
+			unsigned int nHash = ((cmMoves[x][n].fsquare * 64) + cmMoves[x][n].tsquare) * 2654435761u;
+
+			if (!(cmMoves[x][n].moveflag & (MOVE_CAPTURE | MOVE_PROMOTED)) && (nHash & 0x10000))
+				cmMoves[x][n].nScore = (nHash >> 17) & 0xFFF;
+
+			mlMoves[x].pmMoves[n] = BBPackMove(cmMoves[x][n].fsquare, cmMoves[x][n].tsquare, cmMoves[x][n].moveflag);
+			mlMoves[x].nScores[n] = cmMoves[x][n].nScore;
+		}
+		mlMoves[x].nNumMoves = nNumMoves[x];
+	}
+
+	printf("Move selection on %d positions (%d moves), %d iterations, in ns per node:\n", NUM_PERFT_TESTS, nTotalMoves, nIterations);
+
+	for (nPicks = 0; nPicks < 2; nPicks++)	// 0 = all moves, 1 = first move only
+	{
+		for (nTest = 0; nTest < 3; nTest++)	// copying the list only, GetNextMove(), PickMove() on the packed list
+		{
+			starttime = GetTickCount64();
+
+			for (nIter = 0; nIter < nIterations; nIter++)
+			{
+				for (x = 0; x < NUM_PERFT_TESTS; x++)
+				{
+					int	nNum = nNumMoves[x];
+					int	nLast = (nPicks == 0) ? nNum : min(nNum, 1);
+
+					memcpy(cmList, cmMoves[x], nNum * sizeof(CHESSMOVE));	// GetNextMove() flags the moves it has picked
+
+					if (nTest == 1)
+					{
+						for (n = 0; n < nLast; n++)
+							nCheck += GetNextMove(cmList, nNum)->tsquare;
+					}
+					else if (nTest == 2)
+					{
+						nNext = 0;
+						for (n = 0; n < nLast; n++)
+							nCheck += PM_TO(mlMoves[x].pmMoves[PickMove(moOrder, &mlMoves[x], &nNext)]);
+					}
+				}
+			}
+
+			nTime[nTest] = GetTickCount64() - starttime;
+		}
+
+		// don't count copying the list, which the move generator does in the search
+		printf("  %s GetNextMove %.1f, PickMove %.1f\n", (nPicks == 0) ? "all moves: " : "first move:",
+			(double)(max(nTime[1], nTime[0]) - nTime[0]) * 1000000.0 / ((double)nIterations * NUM_PERFT_TESTS),
+			(double)(max(nTime[2], nTime[0]) - nTime[0]) * 1000000.0 / ((double)nIterations * NUM_PERFT_TESTS));
+	}
+}
+
+/*========================================================================
+** AccBenchmark - times making and unmaking every legal move of the perft
+** test positions without the accumulator, with the accumulator updated
+** on both (as on the game board) and with the search's accumulator stack
+** brought up to date after every move, which is its worst case
+**========================================================================
+*/
+void AccBenchmark(int nIterations)
+{
+	static BB_BOARD	bbBoards[NUM_PERFT_TESTS];
+	static MOVELIST	mlMoves[NUM_PERFT_TESTS];
+	CHESSMOVE	cmMove;
+	int			x, n, nIter, nTest, nTotalMoves = 0;
+	unsigned long long	nStart, nCycles;
+	const char*	szTest[3] = { "no accumulator:   ", "update and undo:  ", "accumulator stack:" };
+#if USE_LAZY_ACC_UPDATE
+	int			nTests = 3;
+#else
+	int			nTests = 2;
+#endif
+
+	for (x = 0; x < NUM_PERFT_TESTS; x++)
+	{
+		BBForsytheToBoard(perft_tests[x].fen, &bbBoards[x]);
+		bbBoards[x].inCheck = BBKingInDanger(&bbBoards[x], bbBoards[x].sidetomove);
+		nn_update_all_pieces(bbBoards[x].Accumulator, bbBoards[x].bbPieces);
+		BBGenerateMoveList(&bbBoards[x], &mlMoves[x], GEN_ALL);
+		nTotalMoves += mlMoves[x].nNumMoves;
+	}
+
+	printf("Make and unmake on %d positions (%d moves), %d iterations, in cycles per move:\n", NUM_PERFT_TESTS, nTotalMoves, nIterations);
+
+	for (nTest = 0; nTest < nTests; nTest++)
+	{
+		nStart = __rdtsc();
+
+		for (nIter = 0; nIter < nIterations; nIter++)
+		{
+			for (x = 0; x < NUM_PERFT_TESTS; x++)
+			{
+				bbEvalBoard = bbBoards[x];
+#if USE_LAZY_ACC_UPDATE
+				InitAccStack(&bbEvalBoard);
+#endif
+
+				for (n = 0; n < mlMoves[x].nNumMoves; n++)
+				{
+					BBUnpackMove(&bbEvalBoard, mlMoves[x].pmMoves[n], &cmMove);
+
+					if (nTest == 0)
+					{
+						BBMakeMove(&cmMove, &bbEvalBoard, FALSE);
+						BBUnMakeMove(&cmMove, &bbEvalBoard, FALSE);
+					}
+					else if (nTest == 1)
+					{
+						BBMakeMove(&cmMove, &bbEvalBoard, TRUE);
+						BBUnMakeMove(&cmMove, &bbEvalBoard, TRUE);
+					}
+#if USE_LAZY_ACC_UPDATE
+					else
+					{
+						BBMakeMove(&cmMove, &bbEvalBoard, ACC_LAZY);
+						UpdateAccStack();
+						BBUnMakeMove(&cmMove, &bbEvalBoard, ACC_LAZY);
+					}
+#endif
+				}
+			}
+		}
+
+		nCycles = __rdtsc() - nStart;
+		printf("  %s %.1f\n", szTest[nTest], (double)nCycles / ((double)nIterations * nTotalMoves));
+	}
+}
+
+/*========================================================================
+** EvalBenchmark - times the network on the perft test positions and every
+** position one move away from them, and reports how many of the inputs
+** of its first hidden layer are non-zero
+**========================================================================
+*/
+void EvalBenchmark(int nIterations)
+{
+	static NN_Accumulator	Accumulators[NUM_PERFT_TESTS * (MAX_LEGAL_MOVES + 1)];
+	static int				nColors[NUM_PERFT_TESTS * (MAX_LEGAL_MOVES + 1)];
+	BB_BOARD	Board;
+	MOVELIST	mlMoves;
+	CHESSMOVE	cmMove;
+	int			x, n, nIter, nPositions = 0;
+#if !USE_CEREBRUM_1_0
+	int			nInputs, nBlocks;
+#endif
+	double		dInputs = 0, dBlocks = 0;
+	unsigned long long	nStart, nCycles;
+	volatile int	nCheck = 0;	// so the evals can't be optimized away
+
+	for (x = 0; x < NUM_PERFT_TESTS; x++)
+	{
+		BBForsytheToBoard(perft_tests[x].fen, &Board);
+		nn_update_all_pieces(Board.Accumulator, Board.bbPieces);
+		memcpy(Accumulators[nPositions], Board.Accumulator, sizeof(NN_Accumulator));
+		nColors[nPositions++] = Board.sidetomove;
+
+		BBGenerateMoveList(&Board, &mlMoves, GEN_ALL);
+		for (n = 0; n < mlMoves.nNumMoves; n++)
+		{
+			BBUnpackMove(&Board, mlMoves.pmMoves[n], &cmMove);
+			BBMakeMove(&cmMove, &Board, TRUE);
+			memcpy(Accumulators[nPositions], Board.Accumulator, sizeof(NN_Accumulator));
+			nColors[nPositions++] = Board.sidetomove;
+			BBUnMakeMove(&cmMove, &Board, TRUE);
+		}
+	}
+
+#if !USE_CEREBRUM_1_0
+	for (x = 0; x < nPositions; x++)
+	{
+		nn_sparsity(Accumulators[x], nColors[x], &nInputs, &nBlocks);
+		dInputs += (double)nInputs / (NN_SIZE_L1 * 2);
+		dBlocks += (double)nBlocks / (NN_SIZE_L1 * 2 / 4);
+	}
+#endif
+
+	nStart = __rdtsc();
+	for (nIter = 0; nIter < nIterations; nIter++)
+		for (x = 0; x < nPositions; x++)
+			nCheck += nn_evaluate(Accumulators[x], nColors[x]);
+	nCycles = __rdtsc() - nStart;
+
+	printf("Network eval on %d positions, %d iterations:\n", nPositions, nIterations);
+#if !USE_CEREBRUM_1_0
+	printf("  non-zero inputs: %.1f%%, non-zero blocks of 4: %.1f%%\n", dInputs * 100.0 / nPositions, dBlocks * 100.0 / nPositions);
+#endif
+	printf("  cycles per eval: %.1f\n", (double)nCycles / ((double)nIterations * nPositions));
+
+#if USE_SMALL_NET
+	if (bSmallNet)
+	{
+		nStart = __rdtsc();
+		for (nIter = 0; nIter < nIterations; nIter++)
+			for (x = 0; x < nPositions; x++)
+				nCheck += nn_evaluate_small(Accumulators[x], nColors[x]);
+		nCycles = __rdtsc() - nStart;
+
+		printf("  cycles per small eval: %.1f\n", (double)nCycles / ((double)nIterations * nPositions));
+	}
+#endif
+}
+
+/*========================================================================
+** EvalCheck - compares the network's evals with its 8-bit first layer
+** weights to the ones with the 16-bit weights, on the perft test
+** positions and every position one move away from them
+**========================================================================
+*/
+void EvalCheck(void)
+{
+#if !USE_CEREBRUM_1_0
+	BB_BOARD		Board;
+	MOVELIST		mlMoves;
+	CHESSMOVE		cmMove;
+	NN_Accumulator	Reference;
+	int				x, n, nError, nMaxError = 0, nPositions = 0;
+	double			dError = 0;
+
+	for (x = 0; x < NUM_PERFT_TESTS; x++)
+	{
+		BBForsytheToBoard(perft_tests[x].fen, &Board);
+		nn_update_all_pieces(Board.Accumulator, Board.bbPieces);
+		BBGenerateMoveList(&Board, &mlMoves, GEN_ALL);
+
+		// the position itself, then its children with the accumulator updated as in the search
+		for (n = -1; n < mlMoves.nNumMoves; n++)
+		{
+			if (n >= 0)
+			{
+				BBUnpackMove(&Board, mlMoves.pmMoves[n], &cmMove);
+				BBMakeMove(&cmMove, &Board, TRUE);
+			}
+
+			if (nn_reference_accumulator(Reference, Board.bbPieces) == -1)
+			{
+				printf("The network was read from an 8-bit file, there are no 16-bit weights to compare with\n");
+				return;
+			}
+
+			nError = abs(nn_evaluate(Board.Accumulator, Board.sidetomove) - nn_evaluate(Reference, Board.sidetomove));
+			if (nError > nMaxError)
+				nMaxError = nError;
+			dError += nError;
+			nPositions++;
+
+			if (n >= 0)
+				BBUnMakeMove(&cmMove, &Board, TRUE);
+		}
+	}
+
+	printf("8-bit against 16-bit first layer weights on %d positions:\n", nPositions);
+	printf("  eval error: %.2f average, %d max, bound %d -- %s\n", dError / nPositions, nMaxError, NN_W0_MAX_ERROR,
+		(nMaxError <= NN_W0_MAX_ERROR) ? "OK" : "FAILED");
+#endif
+}
+
 #if USE_KILLERS
 /*========================================================================
 ** UpdateKiller - add a killer move to the killer list
@@ -380,14 +1002,16 @@ static inline void ScoreMoves(CHESSMOVE* MoveList, int nNumMoves)
 */
 static inline void UpdateKiller(int nPly, CHESSMOVE* cmKiller, int nEval)
 {
+	PACKEDMOVE	pmKiller = BBPackMove(cmKiller->fsquare, cmKiller->tsquare, cmKiller->moveflag);
+
 	// check to see if the move is already in the list
-	if ((cmKiller->fsquare == cmKillers[nPly][0].cmKiller.fsquare) && (cmKiller->tsquare == cmKillers[nPly][0].cmKiller.tsquare))
+	if (PM_SQUARES(pmKiller) == PM_SQUARES(cmKillers[nPly][0].pmKiller))
 		return;
 #if (MAX_KILLERS > 1)
-	if ((cmKiller->fsquare == cmKillers[nPly][1].cmKiller.fsquare) && (cmKiller->tsquare == cmKillers[nPly][1].cmKiller.tsquare))
+	if (PM_SQUARES(pmKiller) == PM_SQUARES(cmKillers[nPly][1].pmKiller))
 		return;
 #if (MAX_KILLERS > 2)
-	if ((cmKiller->fsquare == cmKillers[nPly][2].cmKiller.fsquare) && (cmKiller->tsquare == cmKillers[nPly][2].cmKiller.tsquare))
+	if (PM_SQUARES(pmKiller) == PM_SQUARES(cmKillers[nPly][2].pmKiller))
 		return;
 #endif
 #endif
@@ -397,7 +1021,7 @@ static inline void UpdateKiller(int nPly, CHESSMOVE* cmKiller, int nEval)
 #if (MAX_KILLERS > 1)
 		cmKillers[nPly][1] = cmKillers[nPly][0];
 #endif
-		cmKillers[nPly][0].cmKiller = *cmKiller;
+		cmKillers[nPly][0].pmKiller = pmKiller;
 		cmKillers[nPly][0].nEval = nEval;
 	}
 #if (MAX_KILLERS > 1)
@@ -406,13 +1030,13 @@ static inline void UpdateKiller(int nPly, CHESSMOVE* cmKiller, int nEval)
 #if (MAX_KILLERS > 2)
 		cmKillers[nPly][2] = cmKillers[nPly][1];
 #endif
-		cmKillers[nPly][1].cmKiller = *cmKiller;
+		cmKillers[nPly][1].pmKiller = pmKiller;
 		cmKillers[nPly][1].nEval = nEval;
 	}
 #if (MAX_KILLERS > 2)
 	else if (nEval > cmKillers[nPly][2].nEval)
 	{
-		cmKillers[nPly][2].cmKiller = *cmKiller;
+		cmKillers[nPly][2].pmKiller = pmKiller;
 		cmKillers[nPly][2].nEval = nEval;
 	}
 #endif
@@ -598,50 +1222,182 @@ int BBSEEMove(CHESSMOVE* cmMove, int ctSide)
 	return(val);
 }
 
+#if USE_FUTILITY_PRUNING
+/*========================================================================
+** QSFutileGain - the most that a capture or promotion can gain in
+** qsearch, for futility pruning
+**========================================================================
+*/
+static inline int QSFutileGain(CHESSMOVE* cmMove)
+{
+	int	nFutile = PAWN_VAL;
+
+	if (cmMove->moveflag & MOVE_PROMOTED)
+		nFutile = QUEEN_VAL;
+	if (cmMove->moveflag & MOVE_CAPTURE)
+	{
+		if (cmMove->moveflag & MOVE_ENPASSANT)
+			nFutile += PAWN_VAL;
+		else
+			nFutile += nPieceVals[PIECEOF(bbEvalBoard.squares[cmMove->tsquare])];
+	}
+
+	return(nFutile);
+}
+#endif
+
+#if USE_QS_BATCH_EVAL
+// the moves of a qsearch node that the picker has handed out and that survived pruning,
+// waiting to be searched -- the positions after them have been evaluated together
+typedef struct
+{
+	int			nPicked;		// moves handed out by the picker, pruned or not
+	int			nMoves;
+	int			nNext;
+	PACKEDMOVE	pmMoves[NN_BATCH_SIZE];
+	int			nScores[NN_BATCH_SIZE];
+} QS_BATCH;
+
+/*========================================================================
+** QSBatchEval - evaluates the positions after the moves of a batch
+** together, and saves the evals in the eval hash so the stand pat of
+** each child finds its own. Children that BBEvaluate() scores without
+** the network, or that are already in the eval hash, are left out
+**========================================================================
+*/
+static void QSBatchEval(QS_BATCH* qbBatch)
+{
+	static thread_local NN_Accumulator	Accumulators[NN_BATCH_SIZE];
+	PosSignature	dwSignatures[NN_BATCH_SIZE];
+	int				nColors[NN_BATCH_SIZE], nEvals[NN_BATCH_SIZE];
+	CHESSMOVE		cmMove;
+	ACC_ENTRY*		aeParent = UpdateAccStack();
+	int				n, nCount = 0;
+
+	for (n = 0; n < qbBatch->nMoves; n++)
+	{
+		BBUnpackMove(&bbEvalBoard, qbBatch->pmMoves[n], &cmMove);
+
+		// the move's changes to the accumulator are recorded on top of the stack, and applied here to a copy
+		BBMakeMove(&cmMove, &bbEvalBoard, ACC_SEARCH);
+
+		if (!BBIsMaterialDraw(&bbEvalBoard) && (ProbeEvalHash(bbEvalBoard.signature) == NULL))
+		{
+			nn_update_accumulator(Accumulators[nCount], aeParent->Accumulator, pAccTop->ncDel, pAccTop->nDel, pAccTop->ncAdd, pAccTop->nAdd);
+			nColors[nCount] = bbEvalBoard.sidetomove;
+			dwSignatures[nCount++] = bbEvalBoard.signature;
+		}
+
+		BBUnMakeMove(&cmMove, &bbEvalBoard, ACC_SEARCH);
+	}
+
+	if (nCount == 0)
+		return;
+
+	nn_evaluate_batch(Accumulators, nColors, nEvals, nCount);
+	for (n = 0; n < nCount; n++)
+		SaveEvalHash(nEvals[n], dwSignatures[n]);
+}
+
+/*========================================================================
+** NextBatchedMove - NextMove() for BBQuiesce() with batched evals. Up to
+** NN_BATCH_SIZE moves are taken from the picker at a time, the ones that
+** futility pruning or SEE would skip with the current alpha are dropped,
+** and the positions after the others are evaluated together before the
+** first of them is searched. The node's first move is taken alone, as it
+** is the one most likely to cut off and leave the others unsearched
+**========================================================================
+*/
+static PACKEDMOVE NextBatchedMove(MOVE_PICKER* mp, QS_BATCH* qbBatch, int* nScore, int nStandPat, int nAlpha, BOOL bInCheck)
+{
+	PACKEDMOVE	pmMove;
+	CHESSMOVE	cmMove;
+	int			nMoveScore, nWanted;
+
+	if (qbBatch->nNext == qbBatch->nMoves)
+	{
+		nWanted = qbBatch->nPicked ? NN_BATCH_SIZE : 1;
+		qbBatch->nMoves = qbBatch->nNext = 0;
+
+		while ((qbBatch->nMoves < nWanted) && ((pmMove = NextMove(mp, &nMoveScore)) != NO_PACKEDMOVE))
+		{
+			qbBatch->nPicked++;
+
+			// the same pruning as BBQuiesce(), which still checks futility against the alpha of when the move is searched
+			if (!bInCheck)
+			{
+				BBUnpackMove(&bbEvalBoard, pmMove, &cmMove);
+
+				if ((cmMove.moveflag & (MOVE_CAPTURE | MOVE_PROMOTED)) == 0)
+					continue;
+				if ((cmMove.moveflag & MOVE_PROMOTED) && (PIECEOF(cmMove.moveflag) != QUEEN))
+					continue;
+#if USE_FUTILITY_PRUNING
+				if (nStandPat + QSFutileGain(&cmMove) < nAlpha)
+					continue;
+#endif
+#if USE_SEE
+				if ((cmMove.moveflag & MOVE_CAPTURE) && (BBSEEMove(&cmMove, bbEvalBoard.sidetomove) < 0))
+					continue;
+#endif
+			}
+
+			qbBatch->pmMoves[qbBatch->nMoves] = pmMove;
+			qbBatch->nScores[qbBatch->nMoves++] = nMoveScore;
+		}
+
+		// evasions are not batched, nor children that the small network evaluates
+		if ((qbBatch->nMoves > 1) && !bInCheck && !UseSmallNet(1))
+			QSBatchEval(qbBatch);
+	}
+
+	if (qbBatch->nNext == qbBatch->nMoves)
+		return(NO_PACKEDMOVE);
+
+	*nScore = qbBatch->nScores[qbBatch->nNext];
+	return(qbBatch->pmMoves[qbBatch->nNext++]);
+}
+#endif
+
 /*========================================================================
-** Quiesce - Quiescent search extension using captures and promotions only
+** Quiesce - Quiescent search extension using captures and promotions only,
+** nNodeType being NODE_PV or NODE_NONPV
 **========================================================================
 */
 #if USE_QS_RECAPTURE
+template <NODE_TYPE nNodeType>
 int BBQuiesce(int nAlpha, int nBeta, PV* pvLine, SquareType sqTarget)
 #else
+template <NODE_TYPE nNodeType>
 static int BBQuiesce(int nAlpha, int nBeta, PV* pvLine)
 #endif
 {
-	WORD	nNumLegalMoves;
 	int		n;
 	PV		pv;
 	int		nEval, nStandPat;
 	BOOL	bInCheck = bbEvalBoard.inCheck;
-	CHESSMOVE cmEvalMoveListQ[MAX_LEGAL_MOVES];
+	PACKEDMOVE	pmNext;
+	int			nScore;
+	MOVE_PICKER	mp;
+#if USE_QS_BATCH_EVAL
+	QS_BATCH	qbBatch;
+#endif
 
 	assert(bInCheck == BBKingInDanger(&bbEvalBoard, bbEvalBoard.sidetomove));
+	assert((nNodeType != NODE_NONPV) || ((nBeta - nAlpha) == 1));
 
 	if (nQuiesceDepth)
 	{
 		nSearchNodes++;
 #if SHOW_QS_NODES
 		nQNodes++;
-#endif
-#if USE_SMP
-		if (bSlave)
-			smSharedMem->sdSlaveData[nSlaveNum].nSearchNodes++;
 #endif
 	}
 
 	if ((nSearchNodes & nCheckNodes) == 0)
-	{
-		if (CheckForInput(FALSE))
-			HandleCommand();
+		CheckForInterrupt();
 
-		if ((CheckTimeRemaining() == FALSE) && (nEngineCommand != STOP_THINKING))	// a command might tell us to stop
-			nEngineCommand = END_THINKING;
-	}
-
-	if (nEngineCommand == END_THINKING)	// out of time or "move now"
-		return(0);
-
-	if (nEngineCommand == STOP_THINKING)	// just stop thinking and return to the main loop as quickly as possible, losing all search info
+	if (SearchAborted())	// out of time, "move now" or told to stop
 		return(0);
 
 #if USE_MATE_DISTANCE_PRUNING
@@ -666,7 +1422,8 @@ static int BBQuiesce(int nAlpha, int nBeta, PV* pvLine)
 	// probe the hash table
 	int			nHashFlags = 0;
 	BYTE		nHashType = HASH_ALPHA;
-	HASH_ENTRY* heHash = ProbeHash(bbEvalBoard.signature);
+	HASH_ENTRY	heEntry;
+	HASH_ENTRY* heHash = ProbeHash(bbEvalBoard.signature, &heEntry);
 
 	if ((heHash != NULL) && (nEngineMode == ENGINE_PONDERING ? nEvalPly >= 3 : nEvalPly >= 2))
 	{
@@ -737,7 +1494,7 @@ static int BBQuiesce(int nAlpha, int nBeta, PV* pvLine)
 	}
 #endif // USE_HASH_IN_QS
 
-	nStandPat = BBEvaluate(&bbEvalBoard, nAlpha, nBeta);
+	nStandPat = BBEvaluate(&bbEvalBoard, nAlpha, nBeta, UseSmallNet(0));
 
 	if (nEvalPly >= MAX_DEPTH)
 	{
@@ -758,33 +1515,34 @@ static int BBQuiesce(int nAlpha, int nBeta, PV* pvLine)
 	}
 	pv.pvLength = 0;
 
-	BBGenerateAllMoves(&bbEvalBoard, &cmEvalMoveListQ[0], &nNumLegalMoves, !bInCheck);
-
-	if (nNumLegalMoves == 0)
-	{
-		pvLine->pvLength = 0;
-		return(nStandPat);
-	}
+	// captures and promotions only, or all evasions when in check
+	InitMovePicker(&mp, NO_PACKEDMOVE, bInCheck, TRUE);
 
-	//  ScoreMoves(&cmEvalMoveList[0], nNumMoves);	// not necessary unless ScoreMoves() changes!
+#if USE_QS_BATCH_EVAL
+	qbBatch.nPicked = qbBatch.nMoves = qbBatch.nNext = 0;
 
-	for (n = 0; n < nNumLegalMoves; n++)
+	for (n = 0; (pmNext = NextBatchedMove(&mp, &qbBatch, &nScore, nStandPat, nAlpha, bInCheck)) != NO_PACKEDMOVE; n++)
+#else
+	for (n = 0; (pmNext = NextMove(&mp, &nScore)) != NO_PACKEDMOVE; n++)
+#endif
 	{
-		CHESSMOVE	cmMove;
+		// the move is made in its slot of the game move list, which keeps what's needed to unmake it
+		CHESSMOVE*	cmMove = &cmEvalGameMoveList[nEvalMove];
 
-		cmMove = *GetNextMove(&cmEvalMoveListQ[0], nNumLegalMoves);
+		BBUnpackMove(&bbEvalBoard, pmNext, cmMove);
+		cmMove->nScore = nScore;
 
-		assert(bInCheck || (cmMove.moveflag & (MOVE_CAPTURE | MOVE_PROMOTED)));
-		if (!bInCheck && ((cmMove.moveflag & (MOVE_CAPTURE | MOVE_PROMOTED)) == 0))
+		assert(bInCheck || (cmMove->moveflag & (MOVE_CAPTURE | MOVE_PROMOTED)));
+		if (!bInCheck && ((cmMove->moveflag & (MOVE_CAPTURE | MOVE_PROMOTED)) == 0))
 			continue;
 
 		// only check promotions to queen
-		if ((cmMove.moveflag & MOVE_PROMOTED) && (PIECEOF(cmMove.moveflag) != QUEEN))
+		if ((cmMove->moveflag & MOVE_PROMOTED) && (PIECEOF(cmMove->moveflag) != QUEEN))
 			continue;
 
 #if USE_QS_RECAPTURE
-		if (((cmMove.moveflag & MOVE_PROMOTED) == 0) && (nQuiesceDepth >= QS_FULL_DEPTH) &&
-			(cmMove.tsquare != sqTarget) && (sqTarget != NO_SQUARE) && !bInCheck)
+		if (((cmMove->moveflag & MOVE_PROMOTED) == 0) && (nQuiesceDepth >= QS_FULL_DEPTH) &&
+			(cmMove->tsquare != sqTarget) && (sqTarget != NO_SQUARE) && !bInCheck)
 		{
 			continue;
 		}
@@ -794,23 +1552,15 @@ static int BBQuiesce(int nAlpha, int nBeta, PV* pvLine)
 		if (!bInCheck)
 		{
 #if USE_FUTILITY_PRUNING
-			int	nFutile = PAWN_VAL;
-			if (cmMove.moveflag & MOVE_PROMOTED)
-				nFutile = QUEEN_VAL;
-			if (cmMove.moveflag & MOVE_CAPTURE)
-			{
-				if (cmMove.moveflag & MOVE_ENPASSANT)
-					nFutile += PAWN_VAL;
-				else
-					nFutile += nPieceVals[PIECEOF(bbEvalBoard.squares[cmMove.tsquare])];
-			}
-			if (nStandPat + nFutile < nAlpha)
+			if (nStandPat + QSFutileGain(cmMove) < nAlpha)
 				continue;
 #endif
 
-#if USE_SEE
-			if (cmMove.moveflag & MOVE_CAPTURE)
-				//			if ((cmMove.moveflag & MOVE_CAPTURE) /* && (n > 0) */ && ((cmMove.moveflag & MOVE_PROMOTED) == 0))
+			PrefetchHash(BBGetMoveSignature(&bbEvalBoard, cmMove));
+
+#if USE_SEE && !USE_QS_BATCH_EVAL	// NextBatchedMove() has already dropped the losing captures
+			if (cmMove->moveflag & MOVE_CAPTURE)
+				//			if ((cmMove->moveflag & MOVE_CAPTURE) /* && (n > 0) */ && ((cmMove->moveflag & MOVE_PROMOTED) == 0))
 			{
 				int	nSee;
 
@@ -819,7 +1569,7 @@ static int BBQuiesce(int nAlpha, int nBeta, PV* pvLine)
 				memcpy(&BoardTemp, &bbEvalBoard, sizeof(BB_BOARD));
 #endif
 
-				nSee = BBSEEMove(&cmMove, bbEvalBoard.sidetomove);
+				nSee = BBSEEMove(cmMove, bbEvalBoard.sidetomove);
 
 #if VERIFY_BOARD
 				assert(memcmp(&BoardTemp, &bbEvalBoard, sizeof(BB_BOARD)) == 0);
@@ -831,24 +1581,24 @@ static int BBQuiesce(int nAlpha, int nBeta, PV* pvLine)
 #endif
 		}
 
-		BBMakeMove(&cmMove, &bbEvalBoard, TRUE);
-		cmMove.dwSignature = bbEvalBoard.signature;	// bbEvalBoard.signature;
-		cmEvalGameMoveList[nEvalMove++] = cmMove;
+		BBMakeMove(cmMove, &bbEvalBoard, ACC_SEARCH);
+		cmMove->dwSignature = bbEvalBoard.signature;	// bbEvalBoard.signature;
+		nEvalMove++;
 		nEvalPly++;
 		nQuiesceDepth++;
 
 #if USE_QS_RECAPTURE
-		nEval = -BBQuiesce(-nBeta, -nAlpha, &pv, cmMove.tsquare);
+		nEval = -BBQuiesce<nNodeType>(-nBeta, -nAlpha, &pv, cmMove->tsquare);
 #else
-		nEval = -BBQuiesce(-nBeta, -nAlpha, &pv);
+		nEval = -BBQuiesce<nNodeType>(-nBeta, -nAlpha, &pv);
 #endif
 
-		BBUnMakeMove(&cmMove, &bbEvalBoard, TRUE);
+		BBUnMakeMove(cmMove, &bbEvalBoard, ACC_SEARCH);
 		nEvalMove--;
 		nEvalPly--;
 		nQuiesceDepth--;
 
-		if ((nEngineCommand == END_THINKING) || (nEngineCommand == STOP_THINKING))
+		if (SearchAborted())
 			break;
 
 		if (nEval > nAlpha)
@@ -858,9 +1608,9 @@ static int BBQuiesce(int nAlpha, int nBeta, PV* pvLine)
 			/* update the PV */
 			if (pvLine)
 			{
-				pvLine->pv[0].fsquare = cmMove.fsquare;
-				pvLine->pv[0].tsquare = cmMove.tsquare;
-				pvLine->pv[0].moveflag = cmMove.moveflag;
+				pvLine->pv[0].fsquare = cmMove->fsquare;
+				pvLine->pv[0].tsquare = cmMove->tsquare;
+				pvLine->pv[0].moveflag = cmMove->moveflag;
 				memcpy(&pvLine->pv[1], pv.pv, pv.pvLength * sizeof(CHESSMOVE));
 				pvLine->pvLength = pv.pvLength + 1;
 			}
@@ -870,6 +1620,16 @@ static int BBQuiesce(int nAlpha, int nBeta, PV* pvLine)
 		}
 	}
 
+#if USE_QS_BATCH_EVAL
+	n = qbBatch.nPicked;	// as counted without batching, pruned moves included
+#endif
+
+	if (n == 0)
+	{
+		pvLine->pvLength = 0;
+		return(nStandPat);
+	}
+
 	return(nAlpha);
 }
 
@@ -877,23 +1637,31 @@ static int BBQuiesce(int nAlpha, int nBeta, PV* pvLine)
 ** AlphaBeta - Standard Alpha/Beta search with PV capture
 **========================================================================
 */
+template <NODE_TYPE nNodeType>
 static int BBAlphaBeta(int nDepth, int nAlpha, int nBeta, PV* pvLine, BOOL bNullMove)
 {
-	WORD	nNumMoves, n;
+	const BOOL	bRootNode = (nNodeType == NODE_ROOT);
+	const NODE_TYPE	nChildType = (nNodeType == NODE_NONPV) ? NODE_NONPV : NODE_PV;	// of the full window searches of the moves
+
+	WORD	n;
 	int		nEval = 0;
 	PV		pv;
 	int		nReductions = 0;
 	BOOL	bInCheck = bbEvalBoard.inCheck;
 	BOOL    bNullMateThreat = FALSE;
 	CHESSMOVE	cmBestMove;
-	CHESSMOVE	cmEvalMoveList[MAX_LEGAL_MOVES];
+	PACKEDMOVE	pmNext;
+	int			nScore;
+	MOVE_PICKER	mp;
 
 	//    assert(bInCheck == BBKingInDanger(&bbEvalBoard, bbEvalBoard.sidetomove));
+	assert(bRootNode == (nEvalPly == 0));
+	assert((nNodeType != NODE_NONPV) || ((nBeta - nAlpha) == 1));
 
 	nSearchNodes++;
 
 #if FULL_LOG
-	if (nEvalPly == 0)
+	if (bRootNode)
 	{
 		fprintf(logfile, "Calling Alpha Beta -- Depth %d, Alpha %d, Beta %d, Null %d, nEvalPly %d\n", nDepth, nAlpha, nBeta, bNullMove, nEvalPly);
 		fflush(logfile);
@@ -901,18 +1669,9 @@ static int BBAlphaBeta(int nDepth, int nAlpha, int nBeta, PV* pvLine, BOOL bNull
 #endif
 
 	if ((nSearchNodes & nCheckNodes) == 0)
-	{
-		if (CheckForInput(FALSE))
-			HandleCommand();
-
-		if ((CheckTimeRemaining() == FALSE) && (nEngineCommand != STOP_THINKING))	// a command might tell us to stop
-			nEngineCommand = END_THINKING;
-	}
-
-	if (nEngineCommand == END_THINKING)	// out of time or "move now"
-		return(0);
+		CheckForInterrupt();
 
-	if (nEngineCommand == STOP_THINKING)	// just stop thinking and return to the main loop as quickly as possible, losing all search info
+	if (SearchAborted())	// out of time, "move now" or told to stop
 		return(0);
 
 	pv.pvLength = 0;
@@ -920,7 +1679,7 @@ static int BBAlphaBeta(int nDepth, int nAlpha, int nBeta, PV* pvLine, BOOL bNull
 	PosSignature bbSig = bbEvalBoard.signature;
 
 	// check for draw by repetition
-	if (nEvalPly && EvalPositionRepeated(bbSig))
+	if (!bRootNode && EvalPositionRepeated(bbSig))
 	{
 #if 0 // FULL_LOG
 		int	n;
@@ -942,11 +1701,11 @@ static int BBAlphaBeta(int nDepth, int nAlpha, int nBeta, PV* pvLine, BOOL bNull
 	}
 
 	// check for draw by 50-move rule
-	if (nEvalPly && (bbEvalBoard.fifty >= 100))
+	if (!bRootNode && (bbEvalBoard.fifty >= 100))
 	{
 		// verify that the last move wasn't checkmate!
-		BBGenerateAllMoves(&bbEvalBoard, &cmEvalMoveList[0], &nNumMoves, FALSE);
-		if (nNumMoves)
+		BBGenerateMoveList(&bbEvalBoard, &mp.mlMoves, GEN_ALL);
+		if (mp.mlMoves.nNumMoves)
 		{
 			if (nAlpha >= 0)
 				return(nAlpha);
@@ -958,7 +1717,7 @@ static int BBAlphaBeta(int nDepth, int nAlpha, int nBeta, PV* pvLine, BOOL bNull
 
 #if USE_EGTB
 	// Probe Gaviota EGTBs
-	if (nEvalPly && tb_available && (BitCount(bbEvalBoard.bbOccupancy) <= 5))
+	if (!bRootNode && tb_available && (BitCount(bbEvalBoard.bbOccupancy) <= 5))
 	{
 		nEval = GaviotaTBProbe(&bbEvalBoard, (nEvalPly >= 3) && (nDepth <= 2));
 
@@ -981,7 +1740,7 @@ static int BBAlphaBeta(int nDepth, int nAlpha, int nBeta, PV* pvLine, BOOL bNull
 
 	// we've gone to the max search depth, so just evaluate
 	if (nEvalPly >= MAX_DEPTH)
-		return(BBEvaluate(&bbEvalBoard, nAlpha, nBeta));
+		return(BBEvaluate(&bbEvalBoard, nAlpha, nBeta, UseSmallNet(0)));
 
 #if USE_MATE_DISTANCE_PRUNING
 	// mate distance pruning
@@ -1001,18 +1760,20 @@ static int BBAlphaBeta(int nDepth, int nAlpha, int nBeta, PV* pvLine, BOOL bNull
 	}
 #endif
 
-	BOOL bPVNode = (nBeta - nAlpha) > 1;
+	// a null window never widens, so only the root and PV nodes have to look
+	const BOOL bPVNode = (nNodeType != NODE_NONPV) && ((nBeta - nAlpha) > 1);
 
 #if USE_HASH
 	// probe the hash table
 	int			nHashFlags = 0;
 	BYTE		nHashType = HASH_ALPHA;
-	HASH_ENTRY* heHash = ProbeHash(bbSig);
+	HASH_ENTRY	heEntry;
+	HASH_ENTRY* heHash = ProbeHash(bbSig, &heEntry);
 
 	if ((heHash != NULL) && !bPVNode && (nEngineMode == ENGINE_PONDERING ? nEvalPly >= 3 : nEvalPly >= 2))
 	{
 #if FULL_LOG
-		if (nEvalPly == 0)
+		if (bRootNode)
 		{
 			fprintf(logfile, "Got Hash Entry at eval ply %d -- nEval %d, from 0x%02X, to 0x%02X, flags %08X\n",
 				nEvalPly, heHash->h.nEval, heHash->h.from, heHash->h.to, heHash->h.nFlags);
@@ -1035,7 +1796,7 @@ static int BBAlphaBeta(int nDepth, int nAlpha, int nBeta, PV* pvLine, BOOL bNull
 #if FULL_LOG
 				if (bLog)
 					nHashReturns++;
-				if (nEvalPly == 0)
+				if (bRootNode)
 				{
 					fprintf(logfile, "Returning Hash Exact\n");
 					fflush(logfile);
@@ -1053,7 +1814,7 @@ static int BBAlphaBeta(int nDepth, int nAlpha, int nBeta, PV* pvLine, BOOL bNull
 #if FULL_LOG
 				if (bLog)
 					nHashReturns++;
-				if (nEvalPly == 0)
+				if (bRootNode)
 				{
 					fprintf(logfile, "Returning Hash Alpha\n");
 					fflush(logfile);
@@ -1066,7 +1827,7 @@ static int BBAlphaBeta(int nDepth, int nAlpha, int nBeta, PV* pvLine, BOOL bNull
 #if FULL_LOG
 				if (bLog)
 					nHashReturns++;
-				if (nEvalPly == 0)
+				if (bRootNode)
 				{
 					fprintf(logfile, "Returning Hash Beta\n");
 					fflush(logfile);
@@ -1080,11 +1841,6 @@ static int BBAlphaBeta(int nDepth, int nAlpha, int nBeta, PV* pvLine, BOOL bNull
 	HASH_ENTRY* heHash = NULL;
 #endif
 
-#if USE_SMP
-	if (bSlave)
-		smSharedMem->sdSlaveData[nSlaveNum].nSearchNodes++;	// only increment search nodes for slaves if there wasn't a hash cutoff
-#endif
-
 	// depth is 0, return quiescent search score
 	if (nDepth <= 0)
 	{
@@ -1095,13 +1851,18 @@ static int BBAlphaBeta(int nDepth, int nAlpha, int nBeta, PV* pvLine, BOOL bNull
 #endif
 
 #if USE_QS_RECAPTURE
-		return(BBQuiesce(nAlpha, nBeta, pvLine, NO_SQUARE));
+		return(BBQuiesce<nChildType>(nAlpha, nBeta, pvLine, NO_SQUARE));
 #else
-		return(BBQuiesce(nAlpha, nBeta, pvLine));
+		return(BBQuiesce<nChildType>(nAlpha, nBeta, pvLine));
 #endif
 	}
 
+	// use the static eval stored with the hash entry, if any, instead of probing the eval hash as well
 	int nStaticEval = -MAX_WINDOW;
+	int nHashStaticEval = HASH_NO_STATIC_EVAL;	// the static eval saved with this node, only ever the big network's
+	BOOL bSmallNetEval;
+	if (heHash != NULL)
+		nStaticEval = nHashStaticEval = heHash->h.nStaticEval;	// HASH_NO_STATIC_EVAL (-MAX_WINDOW) if it wasn't stored
 
 #if USE_FUTILITY_PRUNING
 	if (!bNullMove && !bPVNode && !bInCheck && (nDepth < 4))
@@ -1109,16 +1870,26 @@ static int BBAlphaBeta(int nDepth, int nAlpha, int nBeta, PV* pvLine, BOOL bNull
 		int nAlphaMargin[4] = { 20000, 150, 275, 325 };
 		int nBetaMargin[4] = { 20000, 75, 150, 275 };
 
-		nStaticEval = BBEvaluate(&bbEvalBoard, -MAX_WINDOW, MAX_WINDOW);
+		if (nStaticEval == -MAX_WINDOW)
+		{
+			bSmallNetEval = UseSmallNet(0);
+			nStaticEval = BBEvaluate(&bbEvalBoard, -MAX_WINDOW, MAX_WINDOW, bSmallNetEval);
+			if (!bSmallNetEval)
+				nHashStaticEval = nStaticEval;
+#if USE_HASH
+			if ((heHash == NULL) && (nHashStaticEval != HASH_NO_STATIC_EVAL))
+				SaveHash(NULL, 0, 0, nHashStaticEval, HASH_NOT_EVAL, nEvalPly, bbSig);	// just the static eval, for the next visit
+#endif
+		}
 
 		if (nStaticEval <= nAlpha - nAlphaMargin[nDepth])
 		{
 			nQuiesceDepth = 0;
 
 #if USE_QS_RECAPTURE
-			int nScore = BBQuiesce(nAlpha - nAlphaMargin[nDepth], nBeta - nAlphaMargin[nDepth], pvLine, NO_SQUARE);
+			int nScore = BBQuiesce<NODE_NONPV>(nAlpha - nAlphaMargin[nDepth], nBeta - nAlphaMargin[nDepth], pvLine, NO_SQUARE);
 #else
-			int nScore = BBQuiesce(nAlpha - nAlphaMargin[nDepth], nBeta - nAlphaMargin[nDepth], pvLine);
+			int nScore = BBQuiesce<NODE_NONPV>(nAlpha - nAlphaMargin[nDepth], nBeta - nAlphaMargin[nDepth], pvLine);
 #endif
 			if (nScore <= nAlpha - nAlphaMargin[nDepth])
 				return(nAlpha);
@@ -1140,7 +1911,7 @@ static int BBAlphaBeta(int nDepth, int nAlpha, int nBeta, PV* pvLine, BOOL bNull
 		if (
 //			nStaticEval >= nBeta || 
 			bPVNode ||
-			(nEvalPly == 0) ||
+			bRootNode ||
 			(nDepth <= 1) ||
 #if USE_HASH
 			(nHashType & HASH_MATE_THREAT) ||
@@ -1160,7 +1931,7 @@ static int BBAlphaBeta(int nDepth, int nAlpha, int nBeta, PV* pvLine, BOOL bNull
 		cmNull.dwSignature = bbEvalBoard.signature;
 		nEvalPly++;
 
-		int null_eval = -BBAlphaBeta(nDepth - 1 - R, -nBeta, -nBeta + 1, &pv, TRUE);
+		int null_eval = -BBAlphaBeta<NODE_NONPV>(nDepth - 1 - R, -nBeta, -nBeta + 1, &pv, TRUE);
 
 #if 0 // FULL_LOG
 		fprintf(logfile, "Got Null Eval -- %d\n", null_eval);
@@ -1172,7 +1943,7 @@ static int BBAlphaBeta(int nDepth, int nAlpha, int nBeta, PV* pvLine, BOOL bNull
 		if (null_eval >= nBeta)
 		{
 #if USE_HASH
-			SaveHash(NULL, nDepth, nBeta, HASH_BETA, nEvalPly, bbSig);
+			SaveHash(NULL, nDepth, nBeta, nHashStaticEval, HASH_BETA, nEvalPly, bbSig);
 #endif
 #if 0 // FULL_LOG
 			fprintf(logfile, "Returning Null Eval\n");
@@ -1187,81 +1958,34 @@ static int BBAlphaBeta(int nDepth, int nAlpha, int nBeta, PV* pvLine, BOOL bNull
 	} while (0);
 #endif
 
-	// finally we generate the legal moves for the current position
-	BBGenerateAllMoves(&bbEvalBoard, &cmEvalMoveList[0], &nNumMoves, FALSE);
-
-	// there are no legal moves! Is it checkmate or draw?
-	if (nNumMoves == 0)
-	{
-		int nRetval = 0;
-		if (bInCheck)
-			nRetval = -CHECKMATE + nEvalPly;
-
-		if (nRetval <= nAlpha)
-			return(nAlpha);
-		else if (nRetval >= nBeta)
-			return(nBeta);
-		else
-			return(nRetval);
-	}
-
-	// check for a move from the hash and put it at the front of the move ordering
-	BOOL	bFound = FALSE;
+	// the hash move is searched before any moves are generated, so it has to be checked for legality here
+	PACKEDMOVE	pmHashMove = NO_PACKEDMOVE;
+	BOOL		bFound = FALSE;
 
 #if USE_HASH
 	if ((heHash != NULL) && (heHash->h.from != NO_SQUARE))
 	{
-		for (n = 0; n < nNumMoves; n++)
-		{
-			if ((cmEvalMoveList[n].fsquare == heHash->h.from) &&
-				(cmEvalMoveList[n].tsquare == heHash->h.to)
-				//				&&	(cmEvalMoveList[n].moveflag == heHash->h.moveflag)
-				)
-			{
-				// make sure that if it's a promotion, that the piece being promoted to is a match
-				if ((cmEvalMoveList[n].moveflag & MOVE_PIECEMASK) == (heHash->h.moveflag & MOVE_PIECEMASK))
-				{
-					cmEvalMoveList[n].nScore += HASH_SORT_VAL;
-					bFound = TRUE;
+		pmHashMove = BBPackMove(heHash->h.from, heHash->h.to, heHash->h.moveflag);
+		bFound = BBMoveIsLegal(&bbEvalBoard, pmHashMove);
 #if FULL_LOG
-					if (nEvalPly == 0)
-					{
-						fprintf(logfile, "hash move found\n");
-						fflush(logfile);
-					}
-#endif
-				}
-			}
-
-			if (bFound)
-				break;
+		if (bFound && bRootNode)
+		{
+			fprintf(logfile, "hash move found\n");
+			fflush(logfile);
 		}
+#endif
 	}
 #else
 	// get the best move from the previous depth 
-	if (nEvalPly == 0)
+	if (bRootNode)
 	{
-//		printf("checking against %d, %d\n", cmChosenMove.fsquare, cmChosenMove.tsquare);
-		for (n = 0; n < nNumMoves; n++)
-		{
-			if ((cmEvalMoveList[n].fsquare == cmChosenMove.fsquare) &&
-				(cmEvalMoveList[n].tsquare == cmChosenMove.tsquare)
-				&& (cmEvalMoveList[n].moveflag == cmChosenMove.moveflag)
-				)
-			{
-				cmEvalMoveList[n].nScore += HASH_SORT_VAL;
-				bFound = TRUE;
-//				printf("found best move\n");
-			}
-
-			if (bFound)
-				break;
-		}
+		pmHashMove = BBPackMove(cmChosenMove.fsquare, cmChosenMove.tsquare, cmChosenMove.moveflag);
+		bFound = BBMoveIsLegal(&bbEvalBoard, pmHashMove);
 	}
 #endif
 
 #if FULL_LOG
-	if ((nEvalPly == 0) && !bFound)
+	if (bRootNode && !bFound)
 	{
 		fprintf(logfile, "hash move NOT found\n");
 		fflush(logfile);
@@ -1275,32 +1999,17 @@ static int BBAlphaBeta(int nDepth, int nAlpha, int nBeta, PV* pvLine, BOOL bNull
 		PV	pvIID;
 		int nScore;
 
-		nScore = BBAlphaBeta(nDepth / 3, nAlpha, nBeta, &pvIID, FALSE);
+		nScore = BBAlphaBeta<nNodeType>(nDepth / 3, nAlpha, nBeta, &pvIID, FALSE);
 #if 1
 		if (nScore <= nAlpha)
-			nScore = BBAlphaBeta(nDepth / 3, -MAX_WINDOW, MAX_WINDOW, &pvIID, FALSE);
+			nScore = BBAlphaBeta<bRootNode ? NODE_ROOT : NODE_PV>(nDepth / 3, -MAX_WINDOW, MAX_WINDOW, &pvIID, FALSE);
 #else
 		if (nScore > nAlpha)
 #endif
+		if (pvIID.pvLength > 0)
 		{
-			for (n = 0; n < nNumMoves; n++)
-			{
-				if ((cmEvalMoveList[n].fsquare == pvIID.pv[0].fsquare) &&
-					(cmEvalMoveList[n].tsquare == pvIID.pv[0].tsquare) 
-					// && (cmEvalMoveList[n].moveflag == pvIID.pv[0].moveflag)
-					)
-				{
-					// make sure that if it's a promotion, that the piece being promoted to is a match
-					if ((cmEvalMoveList[n].moveflag & MOVE_PIECEMASK) == (pvIID.pv[0].moveflag & MOVE_PIECEMASK))
-					{
-						cmEvalMoveList[n].nScore += HASH_SORT_VAL;
-						bFound = TRUE;
-					}
-				}
-
-				if (bFound)
-					break;
-			}
+			pmHashMove = BBPackMove(pvIID.pv[0].fsquare, pvIID.pv[0].tsquare, pvIID.pv[0].moveflag);
+			bFound = BBMoveIsLegal(&bbEvalBoard, pmHashMove);
 		}
 	}
 #endif
@@ -1311,30 +2020,17 @@ static int BBAlphaBeta(int nDepth, int nAlpha, int nBeta, PV* pvLine, BOOL bNull
 		nDepth--;
 #endif
 
-	if (nEngineCommand == END_THINKING)	// out of time or "move now"
+	if (SearchAborted())	// out of time, "move now" or told to stop
 		return(0);
 
-	if (nEngineCommand == STOP_THINKING)	// just stop thinking and return to the main loop as quickly as possible, losing all search info
-		return(0);
-
-	ScoreMoves(&cmEvalMoveList[0], nNumMoves);
+	// moves are generated in stages by the picker, and only when the hash move and the moves before them haven't cut off
+	InitMovePicker(&mp, bFound ? pmHashMove : NO_PACKEDMOVE, bInCheck, FALSE);
 
 #if FULL_LOG
-	if (bLog)
+	if (bLog && bRootNode)
 	{
-		if (nEvalPly == 0)
-		{
-			fprintf(logfile, "Depth = %d, nAlpha = %d, nBeta = %d\n", nDepth, nAlpha, nBeta);
-
-			for (n = 0; n < nNumMoves; n++)
-			{
-				fprintf(logfile, "Move %d: %c%c-%c%c = %08X\n", n,
-					BBSQ2COLNAME(cmEvalMoveList[n].fsquare), BBSQ2ROWNAME(cmEvalMoveList[n].fsquare),
-					BBSQ2COLNAME(cmEvalMoveList[n].tsquare), BBSQ2ROWNAME(cmEvalMoveList[n].tsquare),
-					cmEvalMoveList[n].nScore);
-			}
-			fflush(logfile);
-		}
+		fprintf(logfile, "Depth = %d, nAlpha = %d, nBeta = %d\n", nDepth, nAlpha, nBeta);
+		fflush(logfile);
 	}
 #endif
 
@@ -1344,7 +2040,12 @@ static int BBAlphaBeta(int nDepth, int nAlpha, int nBeta, PV* pvLine, BOOL bNull
 	BOOL bImproving = FALSE;
 
 	if (nStaticEval == -MAX_WINDOW)
-		nStaticEval = BBEvaluate(&bbEvalBoard, -MAX_WINDOW, MAX_WINDOW);
+	{
+		bSmallNetEval = UseSmallNet(0);
+		nStaticEval = BBEvaluate(&bbEvalBoard, -MAX_WINDOW, MAX_WINDOW, bSmallNetEval);
+		if (!bSmallNetEval)
+			nHashStaticEval = nStaticEval;
+	}
 
 	nEvalStack[nEvalPly] = nStaticEval;
 	if ((nEvalPly > 2) && (nEvalStack[nEvalPly] > nEvalStack[nEvalPly - 2]))
@@ -1356,52 +2057,57 @@ static int BBAlphaBeta(int nDepth, int nAlpha, int nBeta, PV* pvLine, BOOL bNull
 #endif
 
 	// loop through legal moves
-	for (n = 0; n < nNumMoves; n++)
+	for (n = 0; (pmNext = NextMove(&mp, &nScore)) != NO_PACKEDMOVE; n++)
 	{
-		CHESSMOVE	cmMove;
+		// the move is made in its slot of the game move list, which keeps what's needed to unmake it
+		CHESSMOVE*	cmMove = &cmEvalGameMoveList[nEvalMove];
 
-		cmMove = *GetNextMove(&cmEvalMoveList[0], nNumMoves);
+		BBUnpackMove(&bbEvalBoard, pmNext, cmMove);
+		cmMove->nScore = nScore;
 
 #if FULL_LOG
 		if (bLog)
 		{
-			if (nEvalPly == 0)
+			if (bRootNode)
 			{
 				char	moveString[16];
 
 				fprintf(logfile, "   ");
-				fprintf(logfile, " looking at move %s -- score = %d, alpha = %d, beta = %d\n", MoveToString(moveString, &cmMove, FALSE), cmMove.nScore, nAlpha, nBeta);
+				fprintf(logfile, " looking at move %s -- score = %d, alpha = %d, beta = %d\n", MoveToString(moveString, cmMove, FALSE), cmMove->nScore, nAlpha, nBeta);
 				fflush(logfile);
 			}
 		}
 #endif
 
+		// start loading the child's hash entries while SEE and the move are being made
+		PrefetchHash(BBGetMoveSignature(&bbEvalBoard, cmMove));
+
 		// get the SEE value of a capture - used by LMR
 		int nSee = 0;
-		if (cmMove.moveflag & MOVE_CAPTURE)
-			nSee = BBSEEMove(&cmMove, bbEvalBoard.sidetomove);
+		if (cmMove->moveflag & MOVE_CAPTURE)
+			nSee = BBSEEMove(cmMove, bbEvalBoard.sidetomove);
 
-		BBMakeMove(&cmMove, &bbEvalBoard, TRUE);
-		cmMove.dwSignature = bbEvalBoard.signature;	// bbEvalBoard.signature;
+		BBMakeMove(cmMove, &bbEvalBoard, ACC_SEARCH);
+		cmMove->dwSignature = bbEvalBoard.signature;	// bbEvalBoard.signature;
 
-		cmEvalGameMoveList[nEvalMove++] = cmMove;
+		nEvalMove++;
 		nEvalPly++;
 
 		nReductions = 0;
 
 		// try some late move reduction conditions
-//      int tsquare = cmMove.tsquare;
+//      int tsquare = cmMove->tsquare;
 //      int tpiece = bbEvalBoard.squares[tsquare];
 
-		if ((nEvalPly > 1)		// not at the root
+		if (!bRootNode			// not at the root
 			// && !bPVNode		// not a PV node
 			&& !bInCheck		// not in check
 			&& (n > 2)			// not one of the first three moves in the movelist
-			&& !(cmMove.moveflag & (MOVE_PROMOTED | MOVE_CHECK | MOVE_OOO | MOVE_OO))	// not a promotion, castling or checking move
-			&& (!(cmMove.moveflag & MOVE_CAPTURE) || (nSee < 0))    // must be either a bad capture or not a capture
+			&& !(cmMove->moveflag & (MOVE_PROMOTED | MOVE_CHECK | MOVE_OOO | MOVE_OO))	// not a promotion, castling or checking move
+			&& (!(cmMove->moveflag & MOVE_CAPTURE) || (nSee < 0))    // must be either a bad capture or not a capture
 			// && (nAlpha > -MATE_THREAT)	// not in a mate threat against the side to move
 			&& (nDepth > 3)			// not at or near the leaves
-			&& (cmMove.nScore < KILLER_3_SORT_VAL)  // not a killer move
+			&& (cmMove->nScore < KILLER_3_SORT_VAL)  // not a killer move
 			// && ((PIECEOF(tpiece) != PAWN) || !IsPassedPawn(&bbEvalBoard, tsquare, (COLOROF(tpiece) == XWHITE ? WHITE : BLACK))) // not a move by a passer
 			)
 		{
@@ -1413,20 +2119,20 @@ static int BBAlphaBeta(int nDepth, int nAlpha, int nBeta, PV* pvLine, BOOL bNull
 			if (nReductions && bImproving)
 				nReductions--;
 #endif
-//			if (nReductions && (cmMove.nScore >= KILLER_3_SORT_VAL) && !(cmMove.moveflag & MOVE_CAPTURE))  // reduce less for quiet killer moves
+//			if (nReductions && (cmMove->nScore >= KILLER_3_SORT_VAL) && !(cmMove->moveflag & MOVE_CAPTURE))  // reduce less for quiet killer moves
 //				nReductions--;
-//			if (nReductions && (cmMove.moveflag & 0x70)) // (MOVE_PROMOTED | MOVE_OOO | MOVE_OO)
+//			if (nReductions && (cmMove->moveflag & 0x70)) // (MOVE_PROMOTED | MOVE_OOO | MOVE_OO)
 //				nReductions--;
 		}
 
-		// try some extension conditions - check or single reply
-		if ((cmMove.moveflag & MOVE_CHECK) || (nNumMoves == 1))
+		// try some extension conditions - check or single reply (all evasions are generated up front when in check)
+		if ((cmMove->moveflag & MOVE_CHECK) || (bInCheck && (mp.mlMoves.nNumMoves == 1)))
 			nReductions--;
 
 #if USE_LMP
-		if (bUseLMP && (n > (12 + (nDepth * 2))) && !(cmMove.moveflag & MOVE_CHECK) && (nEvalPly > 1) && (nReductions >= 0))
+		if (bUseLMP && (n > (12 + (nDepth * 2))) && !(cmMove->moveflag & MOVE_CHECK) && !bRootNode && (nReductions >= 0))
 		{
-			BBUnMakeMove(&cmMove, &bbEvalBoard, TRUE);
+			BBUnMakeMove(cmMove, &bbEvalBoard, ACC_SEARCH);
 			nEvalMove--;
 			nEvalPly--;
 			continue;
@@ -1438,15 +2144,15 @@ static int BBAlphaBeta(int nDepth, int nAlpha, int nBeta, PV* pvLine, BOOL bNull
 
 		// PVS
 		if (n == 0)
-			nEval = -BBAlphaBeta(nDepth - 1 - nReductions, -nBeta, -nAlpha, &pv, FALSE);    // reduced full window for first move in list
+			nEval = -BBAlphaBeta<nChildType>(nDepth - 1 - nReductions, -nBeta, -nAlpha, &pv, FALSE);    // reduced full window for first move in list
 		else
 		{
-			nEval = -BBAlphaBeta(nDepth - 1 - nReductions, -nAlpha - 1, -nAlpha, &pv, FALSE); // reduced null window search for all other moves
+			nEval = -BBAlphaBeta<NODE_NONPV>(nDepth - 1 - nReductions, -nAlpha - 1, -nAlpha, &pv, FALSE); // reduced null window search for all other moves
 #if 1
-			if ((nEval > nAlpha) && bPVNode && (nEngineCommand != STOP_THINKING) && (nEngineCommand != END_THINKING))
+			if ((nEval > nAlpha) && bPVNode && !SearchAborted())
 			{
 				//	memset(&pv, 0, sizeof(PV));
-				nEval = -BBAlphaBeta(nDepth - 1 - nReductions, -nBeta, -nAlpha, &pv, FALSE);   // reduced full window search if promising
+				nEval = -BBAlphaBeta<NODE_PV>(nDepth - 1 - nReductions, -nBeta, -nAlpha, &pv, FALSE);   // reduced full window search if promising
 			}
 #endif
 		}
@@ -1454,36 +2160,36 @@ static int BBAlphaBeta(int nDepth, int nAlpha, int nBeta, PV* pvLine, BOOL bNull
 		// if we did a depth reduction but improved alpha, research at proper depth
 		if ((nEval > nAlpha) && (nReductions > 0))
 		{
-			if ((nEngineCommand != STOP_THINKING) && (nEngineCommand != END_THINKING))
-				nEval = -BBAlphaBeta(nDepth - 1, -nBeta, -nAlpha, &pv, FALSE);  // full-depth full window if still promising
+			if (!SearchAborted())
+				nEval = -BBAlphaBeta<nChildType>(nDepth - 1, -nBeta, -nAlpha, &pv, FALSE);  // full-depth full window if still promising
 		}
 
-		BBUnMakeMove(&cmMove, &bbEvalBoard, TRUE);
+		BBUnMakeMove(cmMove, &bbEvalBoard, ACC_SEARCH);
 		nEvalMove--;
 		nEvalPly--;
 
 #if FULL_LOG
-		if (bLog && nEvalPly == 0)
+		if (bLog && bRootNode)
 		{
 			fprintf(logfile, "		eval = %d\n", nEval);
 			fflush(logfile);
 		}
 #endif
 
-		if ((nEngineCommand == END_THINKING) || (nEngineCommand == STOP_THINKING))
+		if (SearchAborted())
 			break;
 
-		if ((nEval > nAlpha) || ((nEvalPly == 0) && (n == 0)))
+		if ((nEval > nAlpha) || (bRootNode && (n == 0)))
 		{
 #if FULL_LOG
-			if (bLog && nEvalPly == 0)
+			if (bLog && bRootNode)
 			{
 				fprintf(logfile, "		alpha improved\n");
 				fflush(logfile);
 			}
 #endif
 
-			cmBestMove = cmMove;
+			cmBestMove = *cmMove;
 
 #if USE_HISTORY
 			if (((cmBestMove.moveflag & MOVE_CAPTURE) == 0) && (nDepth > 1))
@@ -1493,14 +2199,14 @@ static int BBAlphaBeta(int nDepth, int nAlpha, int nBeta, PV* pvLine, BOOL bNull
 			/* update the PV */
 			if (pvLine)
 			{
-				pvLine->pv[0].fsquare = cmMove.fsquare;
-				pvLine->pv[0].tsquare = cmMove.tsquare;
-				pvLine->pv[0].moveflag = cmMove.moveflag;
+				pvLine->pv[0].fsquare = cmMove->fsquare;
+				pvLine->pv[0].tsquare = cmMove->tsquare;
+				pvLine->pv[0].moveflag = cmMove->moveflag;
 				memcpy(&pvLine->pv[1], &pv.pv, pv.pvLength * sizeof(PVMOVE));
 				pvLine->pvLength = pv.pvLength + 1;
 			}
 
-			if (nEvalPly == 0)
+			if (bRootNode && (nThreadNum == 0))
 			{
 				char	comment;
 
@@ -1537,11 +2243,11 @@ static int BBAlphaBeta(int nDepth, int nAlpha, int nBeta, PV* pvLine, BOOL bNull
 #endif
 
 #if USE_HASH
-				SaveHash(&cmBestMove, nDepth, nBeta, HASH_BETA | (bNullMateThreat ? HASH_MATE_THREAT : 0), nEvalPly, bbSig);
+				SaveHash(&cmBestMove, nDepth, nBeta, nHashStaticEval, HASH_BETA | (bNullMateThreat ? HASH_MATE_THREAT : 0), nEvalPly, bbSig);
 #endif
 
 #if FULL_LOG
-				if (bLog && nEvalPly == 0)
+				if (bLog && bRootNode)
 				{
 					fprintf(logfile, "		beta improved\n");
 					fflush(logfile);
@@ -1551,17 +2257,32 @@ static int BBAlphaBeta(int nDepth, int nAlpha, int nBeta, PV* pvLine, BOOL bNull
 				return(nBeta);
 			}
 
-			if (nEvalPly == 0)
+			if (bRootNode)
 				nCurEval = nEval;
 		}
 	}
 
+	// there were no legal moves! Is it checkmate or draw?
+	if ((n == 0) && !SearchAborted())
+	{
+		int nRetval = 0;
+		if (bInCheck)
+			nRetval = -CHECKMATE + nEvalPly;
+
+		if (nRetval <= nAlpha)
+			return(nAlpha);
+		else if (nRetval >= nBeta)
+			return(nBeta);
+		else
+			return(nRetval);
+	}
+
 #if USE_HASH
-	if ((nEngineCommand != END_THINKING) && (nEngineCommand != STOP_THINKING))
+	if (!SearchAborted())
 	{
 		// only save to the hash if we had a move that improved alpha
 		if (cmBestMove.fsquare != NO_SQUARE)
-			SaveHash(&cmBestMove, nDepth, nAlpha, nHashType | (bNullMateThreat ? HASH_MATE_THREAT : 0), nEvalPly, bbSig);
+			SaveHash(&cmBestMove, nDepth, nAlpha, nHashStaticEval, nHashType | (bNullMateThreat ? HASH_MATE_THREAT : 0), nEvalPly, bbSig);
 	}
 #endif
 
@@ -1584,10 +2305,30 @@ int	Think(int nDepth)
 #if USE_NULL_MOVE
 	bIsNullOk = BBIsNullOk();
 #endif
+#if USE_SMALL_NET
+	// bullet, or time trouble -- a fixed time, depth or node count is neither
+	bShortOfTime = (nEngineMode != ENGINE_ANALYZING) && !bExactThinkTime && !bExactThinkDepth && !bExactThinkNodes &&
+		(nClockRemaining < SMALL_NET_CLOCK);
+#endif
 
-	bbEvalBoard = bbBoard;
-	memcpy(cmEvalGameMoveList, cmGameMoveList, sizeof(cmEvalGameMoveList));
-	nEvalMove = nGameMove;
+#if USE_SMP
+	if (nThreadNum)
+	{
+		bbEvalBoard = bbSMPRoot;
+		memcpy(cmEvalGameMoveList, cmSMPRootMoveList, sizeof(cmEvalGameMoveList));
+		nEvalMove = nSMPRootMove;
+	}
+	else
+#endif
+	{
+		bbEvalBoard = bbBoard;
+		memcpy(cmEvalGameMoveList, cmGameMoveList, sizeof(cmEvalGameMoveList));
+		nEvalMove = nGameMove;
+	}
+
+#if USE_LAZY_ACC_UPDATE
+	InitAccStack(&bbEvalBoard);
+#endif
 
 	evalPV.pvLength = 0;
 
@@ -1608,7 +2349,8 @@ int	Think(int nDepth)
 		ClearHistory();
 #endif
 #if USE_HASH
-//      nHashAge++;
+		if (nThreadNum == 0)
+			NewHashGeneration();
 //		ClearHash();
 #endif
 	}
@@ -1630,7 +2372,7 @@ int	Think(int nDepth)
 		}
 #endif
 
-		nEval = BBAlphaBeta(nDepth, -MAX_WINDOW, MAX_WINDOW, &evalPV, FALSE);
+		nEval = BBAlphaBeta<NODE_ROOT>(nDepth, -MAX_WINDOW, MAX_WINDOW, &evalPV, FALSE);
 	}
 	else
 	{
@@ -1660,10 +2402,9 @@ int	Think(int nDepth)
 				nHighWindow = MAX_WINDOW;
 			}
 
-			nEval = BBAlphaBeta(nDepth, nLowWindow, nHighWindow, &evalPV, FALSE);
+			nEval = BBAlphaBeta<NODE_ROOT>(nDepth, nLowWindow, nHighWindow, &evalPV, FALSE);
 
-			if ((nEngineCommand != STOP_THINKING) && (nEngineCommand != END_THINKING) &&
-				((nEval <= nLowWindow) || (nEval >= nHighWindow)))
+			if (!SearchAborted() && ((nEval <= nLowWindow) || (nEval >= nHighWindow)))
 			{
 				int nDiff = nNumSearches * ASPIRATION_WINDOW;
 
@@ -1685,10 +2426,23 @@ int	Think(int nDepth)
 	}
 #else	// USE_ASPIRATION
 
-	nEval = BBAlphaBeta(nDepth, -MAX_WINDOW, MAX_WINDOW, &evalPV, FALSE);
+	nEval = BBAlphaBeta<NODE_ROOT>(nDepth, -MAX_WINDOW, MAX_WINDOW, &evalPV, FALSE);
 
 #endif	// USE_ASPIRATION
 
+#if USE_SMP
+	if (nThreadNum)	// helpers only feed the hash table, the main thread picks the move
+	{
+		if (!bStopHelpers && evalPV.pvLength && (nEval != MAX_WINDOW) && (nEval != -MAX_WINDOW))
+		{
+			nPrevEval = nEval;
+			prevDepthPV = evalPV;
+		}
+
+		return(nEval);
+	}
+#endif
+
 	if (nEngineCommand == STOP_THINKING)
 		return(0);
 
@@ -1713,6 +2467,99 @@ int	Think(int nDepth)
 	return(nEval);
 }
 
+#if USE_SMP
+/*========================================================================
+** HelperThink - iterative deepening loop of a Lazy SMP helper thread.
+** Helpers search the same root as the main thread and only share their
+** results through the transposition table. Odd numbered helpers search
+** one ply deeper to keep the threads from searching identical trees.
+**========================================================================
+*/
+static void HelperThink(int nThread)
+{
+	int		nDepth;
+
+	nThreadNum = nThread;
+	nSearchNodes = 0;
+#if USE_EVAL_HASH
+	SetEvalHashThread(nThread);
+#endif
+
+	for (nDepth = 1; (nDepth <= MAX_DEPTH) && !bStopHelpers; nDepth++)
+	{
+		if ((nDepth > 1) && (nThread & 1))
+			Think(min(nDepth + 1, MAX_DEPTH));
+		else
+			Think(nDepth);
+	}
+
+	smpThreads[nThread].nSearchNodes = nSearchNodes;
+}
+#endif
+
+/*========================================================================
+** StartHelperThreads - snapshot the game and start the Lazy SMP helpers
+**========================================================================
+*/
+void StartHelperThreads(void)
+{
+#if USE_SMP
+	int	n;
+
+	if (nCPUs <= 1)
+		return;
+
+	bbSMPRoot = bbBoard;
+	memcpy(cmSMPRootMoveList, cmGameMoveList, sizeof(cmSMPRootMoveList));
+	nSMPRootMove = nGameMove;
+
+	bStopHelpers = FALSE;
+
+	for (n = 1; n < nCPUs; n++)
+	{
+		smpThreads[n].nSearchNodes = 0;
+		smpThreads[n].thread = std::thread(HelperThink, n);
+	}
+#endif
+}
+
+/*========================================================================
+** StopHelperThreads - tell the Lazy SMP helpers to stop and wait for them
+**========================================================================
+*/
+void StopHelperThreads(void)
+{
+#if USE_SMP
+	int	n;
+
+	bStopHelpers = TRUE;
+
+	for (n = 1; n < MAX_CPUS; n++)
+	{
+		if (smpThreads[n].thread.joinable())
+			smpThreads[n].thread.join();
+	}
+#endif
+}
+
+/*========================================================================
+** GetSMPNodes - number of nodes searched by all threads
+**========================================================================
+*/
+unsigned long long GetSMPNodes(void)
+{
+	unsigned long long	nNodes = nSearchNodes;
+
+#if USE_SMP
+	int	n;
+
+	for (n = 1; n < nCPUs; n++)
+		nNodes += smpThreads[n].nSearchNodes;
+#endif
+
+	return(nNodes);
+}
+
 void InitThink(void)
 {
 	int d, m, red;
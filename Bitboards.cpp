@@ -42,6 +42,8 @@ Bitboard	wkc, wqc, bkc, bqc;
 // Bitboard	bbDiagonalMoves[64];
 // Bitboard	bbStraightMoves[64];
 // Bitboard	bbBetween[8][8];
+Bitboard	bbSquaresBetween[64][64];
+Bitboard	bbSquaresLine[64][64];
 
 const Bitboard RankMask[8] =
 {
@@ -70,6 +72,92 @@ int VFlipSquare[64] = {
 
 BB_BOARD	bbBoard;
 
+#if USE_LAZY_ACC_UPDATE
+thread_local ACC_ENTRY	aeAccStack[MAX_DEPTH + 2];
+thread_local ACC_ENTRY*	pAccTop = aeAccStack;
+thread_local BB_BOARD*	pAccBoard = NULL;
+
+/*========================================================================
+** DelAccPiece, AddAccPiece - record a piece taken off or put on the board
+** on the top of the accumulator stack. A pawn that promotes is put on the
+** last rank by MovePiece() and taken right off again, so that cancels out
+**========================================================================
+*/
+static inline void DelAccPiece(int piece, int color, int square)
+{
+	NN_Change*	nc;
+
+	if (pAccTop->nAdd)
+	{
+		nc = &pAccTop->ncAdd[pAccTop->nAdd - 1];
+		if ((nc->piece_position == square) && (nc->piece_type == piece) && (nc->piece_color == color))
+		{
+			pAccTop->nAdd--;
+			return;
+		}
+	}
+
+	assert(pAccTop->nDel < NN_MAX_CHANGES);
+
+	nc = &pAccTop->ncDel[pAccTop->nDel++];
+	nc->piece_type = piece;
+	nc->piece_color = color;
+	nc->piece_position = square;
+}
+
+static inline void AddAccPiece(int piece, int color, int square)
+{
+	NN_Change*	nc;
+
+	assert(pAccTop->nAdd < NN_MAX_CHANGES);
+
+	nc = &pAccTop->ncAdd[pAccTop->nAdd++];
+	nc->piece_type = piece;
+	nc->piece_color = color;
+	nc->piece_position = square;
+}
+
+/*========================================================================
+** InitAccStack - start the accumulator stack from a board with an up to
+** date accumulator, which is then made and unmade with ACC_LAZY
+**========================================================================
+*/
+void InitAccStack(BB_BOARD* Board)
+{
+	memcpy(aeAccStack[0].Accumulator, Board->Accumulator, sizeof(NN_Accumulator));
+	aeAccStack[0].bComputed = TRUE;
+	aeAccStack[0].nDel = aeAccStack[0].nAdd = 0;
+
+	pAccTop = aeAccStack;
+	pAccBoard = Board;
+}
+
+/*========================================================================
+** UpdateAccStack - bring the accumulator on top of the stack up to date,
+** starting from the nearest entry below it that already is. Each entry
+** is the one below with the pieces of its move taken off and put on, in
+** a single pass
+**========================================================================
+*/
+ACC_ENTRY* UpdateAccStack(void)
+{
+	ACC_ENTRY*	ae = pAccTop;
+
+	while (!ae->bComputed)
+		ae--;
+
+	for (; ae < pAccTop; ae++)
+	{
+		ACC_ENTRY*	aeNext = ae + 1;
+
+		nn_update_accumulator(aeNext->Accumulator, ae->Accumulator, aeNext->ncDel, aeNext->nDel, aeNext->ncAdd, aeNext->nAdd);
+		aeNext->bComputed = TRUE;
+	}
+
+	return(pAccTop);
+}
+#endif
+
 void RemovePiece(BB_BOARD* Board, int square, BOOL bUpdateNN)
 {
 	IS_SQ_OK(square);
@@ -85,6 +173,11 @@ void RemovePiece(BB_BOARD* Board, int square, BOOL bUpdateNN)
 	ClearBit(&Board->bbOccupancy, square);
 
 #if USE_INCREMENTAL_ACC_UPDATE
+#if USE_LAZY_ACC_UPDATE
+	if (bUpdateNN == ACC_LAZY)
+		DelAccPiece(5 - pstpiece, color, square ^ 56);
+	else
+#endif
 	if (bUpdateNN)
 #if USE_CEREBRUM_1_0
 		nn_del_piece(Board->Accumulator, pstpiece, color, square ^ 56);
@@ -108,6 +201,11 @@ void PutPiece(BB_BOARD *Board, int piece, int square, BOOL bUpdateNN)
     SetBit(&Board->bbOccupancy, square);
 
 #if USE_INCREMENTAL_ACC_UPDATE
+#if USE_LAZY_ACC_UPDATE
+	if (bUpdateNN == ACC_LAZY)
+		AddAccPiece(5 - pstpiece, color, square ^ 56);
+	else
+#endif
 	if (bUpdateNN)
 #if USE_CEREBRUM_1_0
 		nn_add_piece(Board->Accumulator, pstpiece, color, square ^ 56);
@@ -137,6 +235,14 @@ void MovePiece(BB_BOARD* Board, int from, int to, BOOL bUpdateNN)
 	SetBit(&Board->bbOccupancy, to);
 
 #if USE_INCREMENTAL_ACC_UPDATE
+#if USE_LAZY_ACC_UPDATE
+	if (bUpdateNN == ACC_LAZY)
+	{
+		DelAccPiece(5 - pstpiece, color, from ^ 56);
+		AddAccPiece(5 - pstpiece, color, to ^ 56);
+	}
+	else
+#endif
 	if (bUpdateNN)
 #if USE_CEREBRUM_1_0
 		nn_mov_piece(Board->Accumulator, pstpiece, color, from ^ 56, to ^ 56);
@@ -154,11 +260,16 @@ void initbitboards(void)
     for (sq = 0; sq <= 63; sq++)
         Bit[sq] = (0x01ULL << sq);
 
-#ifdef _WIN64
+#if defined(_M_X64) || defined(__x86_64__)
     // check for 64-bit popcnt support
+#ifdef _MSC_VER
     int CPUInfo[4] = {-1};
     __cpuid(CPUInfo, 1);
-    bPopcnt = CPUInfo[2] & 0x800000;
+    bPopcnt = (CPUInfo[2] & 0x800000) != 0;
+#else
+    __builtin_cpu_init();
+    bPopcnt = __builtin_cpu_supports("popcnt") != 0;
+#endif
 #endif
 
     // takes care of all queen, rook and bishop moves -- thanks, Pradu!
@@ -404,6 +515,31 @@ void initbitboards(void)
 	}
 #endif
 
+	// squares between and lines through any two aligned squares - used for pins and check evasions
+	int	from, to;
+
+	for (from = 0; from <= 63; from++)
+	{
+		for (to = 0; to <= 63; to++)
+		{
+			bbSquaresBetween[from][to] = bbSquaresLine[from][to] = BB_EMPTY;
+
+			if (from == to)
+				continue;
+
+			if (Rmagic(from, 0) & Bit[to])
+			{
+				bbSquaresBetween[from][to] = Rmagic(from, Bit[to]) & Rmagic(to, Bit[from]);
+				bbSquaresLine[from][to] = (Rmagic(from, 0) & Rmagic(to, 0)) | Bit[from] | Bit[to];
+			}
+			else if (Bmagic(from, 0) & Bit[to])
+			{
+				bbSquaresBetween[from][to] = Bmagic(from, Bit[to]) & Bmagic(to, Bit[from]);
+				bbSquaresLine[from][to] = (Bmagic(from, 0) & Bmagic(to, 0)) | Bit[from] | Bit[to];
+			}
+		}
+	}
+
 	// masks for checking castling squares
 	wkc = Bit[BB_F1] | Bit[BB_G1];
 	wqc = Bit[BB_B1] | Bit[BB_C1] | Bit[BB_D1];
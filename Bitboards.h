@@ -91,6 +91,7 @@ extern BOOL		bPopcnt;
 // common inline functions
 __inline DWORD BitScan(Bitboard bb)
 {
+    // tzcnt runs as bsf on CPUs without BMI1, which gives the same result for a non-empty bitboard
     assert(bb);
     return(DWORD)(_tzcnt_u64(bb));
 }
@@ -158,25 +159,30 @@ __inline Bitboard PopLSB(Bitboard *bb)
     return lsb;
 }
 
+#if defined(_M_X64) || defined(__x86_64__)
+// the popcnt instruction whatever the compiler targets, only used once initbitboards() has found it
+__inline int HardwareBitCount(Bitboard b)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    return((int)__popcnt64(b));
+#else
+    Bitboard n;
+    __asm__("popcntq %1, %0" : "=r" (n) : "r" (b));
+    return((int)n);
+#endif
+}
+#endif
+
 __inline int BitCount(Bitboard b)
 {
-#ifdef _WIN64
-#ifdef MINGW
-    if (bPopcnt)
-        return((int)__builtin_popcountll(b));
+#if defined(__POPCNT__) || defined(__aarch64__)
+    // the compiler targets it already
+    return(__builtin_popcountll(b));
 #else
+#if defined(_M_X64) || defined(__x86_64__)
     if (bPopcnt)
-        return((int)__popcnt64(b));
+        return(HardwareBitCount(b));
 #endif
-    else
-    {
-        b -= ((b>>1) & 0x5555555555555555ULL);
-        b = ((b>>2) & 0x3333333333333333ULL) + (b & 0x3333333333333333ULL);
-        b = ((b>>4) + b) & 0x0F0F0F0F0F0F0F0FULL;
-        b *= 0x0101010101010101ULL;
-        return b >> 56;
-    }
-#else
     b -= ((b>>1) & 0x5555555555555555ULL);
     b = ((b>>2) & 0x3333333333333333ULL) + (b & 0x3333333333333333ULL);
     b = ((b>>4) + b) & 0x0F0F0F0F0F0F0F0FULL;
@@ -217,6 +223,29 @@ typedef struct
 
 extern BB_BOARD	bbBoard;
 
+#if USE_LAZY_ACC_UPDATE
+// bUpdateNN/bUpdateAcc value used by the search -- changes are recorded on the accumulator stack instead of being applied
+#define ACC_LAZY	2
+
+// the pieces taken off and put on by a move, as the network wants them
+typedef struct alignas(64)	// full-width vector loads and stores of the accumulator never split a cache line
+{
+	NN_Accumulator	Accumulator;
+	BOOL			bComputed;	// Accumulator is only valid once the entry has been brought up to date
+	int				nDel, nAdd;
+	NN_Change		ncDel[NN_MAX_CHANGES];
+	NN_Change		ncAdd[NN_MAX_CHANGES];
+} ACC_ENTRY;
+
+// one entry per ply of the search, for the search board of each thread
+extern thread_local ACC_ENTRY	aeAccStack[MAX_DEPTH + 2];
+extern thread_local ACC_ENTRY*	pAccTop;
+extern thread_local BB_BOARD*	pAccBoard;
+
+void InitAccStack(BB_BOARD *Board);
+ACC_ENTRY* UpdateAccStack(void);
+#endif
+
 extern Bitboard bbPawnMoves[2][64];
 extern Bitboard bbPawnAttacks[2][64];
 extern Bitboard bbKnightMoves[64];
@@ -227,6 +256,8 @@ extern const Bitboard RankMask[8], FileMask[8];
 // extern Bitboard bbDiagonalMoves[64];
 // extern Bitboard bbStraightMoves[64];
 // extern Bitboard bbBetween[8][8];
+extern Bitboard bbSquaresBetween[64][64];
+extern Bitboard bbSquaresLine[64][64];
 
 void RemovePiece(BB_BOARD *Board, int square, BOOL bUpdateNN);
 void PutPiece(BB_BOARD *Board, int piece, int square, BOOL bUpdateNN);
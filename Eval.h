@@ -18,4 +18,8 @@ along with this program.If not, see < https://www.gnu.org/licenses/>.
 
 extern const int	nPieceVals[NPIECES];
 
-int BBEvaluate(BB_BOARD *EvalBoard, int nAlpha, int nBeta);
+int BBEvaluate(BB_BOARD *EvalBoard, int nAlpha, int nBeta, BOOL bUseSmallNet);
+BOOL BBIsMaterialDraw(BB_BOARD *EvalBoard);
+#if !USE_CEREBRUM_1_0
+int EvalBatchFile(char *szInFile, char *szOutFile, int *nSkipped);
+#endif
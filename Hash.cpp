@@ -19,24 +19,32 @@ along with this program.If not, see < https://www.gnu.org/licenses/>.
 #include <sys/types.h>
 #include <sys/timeb.h>
 #include <iostream>
+#include <thread>
+#include <atomic>
 
 #include "Myrddin.h"
 #include "Bitboards.h"
 #include "Hash.h"
 #include "PArray.inc"
 
+#if !USE_CEREBRUM_1_0
+#include "cerebrum 2-0.h"
+#endif
+
 #define LOG_HASH		FALSE
-#define ALWAYS_REPLACE	TRUE
-#define USE_INTERLOCKED FALSE
-#define HASH_AGING_FACTOR	4	// min number of plies difference between stored and incoming entry, including hash age
+#define HASH_AGING_FACTOR	4	// plies of depth that each search of age costs a stored entry when picking one to replace
+#define MIN_THREAD_EVAL_HASH_SIZE	(0x10000)	// smallest per-thread eval hash, in entries
 
-HASH_ENTRY		*HashTable = NULL;
-EVAL_HASH_ENTRY *EvalHashTable = NULL;
+HASH_BUCKET		*HashTable = NULL;	// shared by all search threads
+size_t			dwHashBuckets = DEFAULT_HASH_SIZE / HASH_BUCKET_SIZE;
+std::atomic<BYTE>	nHashGeneration(0);	// bumped by the main thread at the start of every search, read by all of them
+static BOOL		bNormalPages = FALSE;	// some hash table is in normal pages, which get their memory when first touched
+EVAL_HASH_ENTRY *EvalHashTables[MAX_CPUS];	// one eval hash per search thread
+thread_local EVAL_HASH_ENTRY *EvalHashTable = NULL;	// the eval hash of the current thread
 
 size_t	dwHashSize = DEFAULT_HASH_SIZE;	// this is the number of entries, not the actual memory size
-size_t	dwEvalHashSize = DEFAULT_HASH_SIZE * 2;	// ditto here
-
-// short	nHashAge = 0;
+size_t	dwEvalHashSize = DEFAULT_HASH_SIZE;	// ditto here, for all threads combined
+size_t	dwThreadEvalHashSize = DEFAULT_HASH_SIZE;	// number of entries in each thread's eval hash
 
 int	nHashBails = 0;
 int	nHashSaves = 0;
@@ -51,39 +59,66 @@ int nEvalHashProbes = 0;
 int nEvalHashBails = 0;
 
 /*========================================================================
-** ProbeHash - probes the transposition table for a matching entry
+** ReadHashEntry - copies a hash entry, undoing the lockless key encoding
 **========================================================================
 */
-HASH_ENTRY *ProbeHash(PosSignature dwSignature)
+static inline void ReadHashEntry(HASH_ENTRY *pEntry, HASH_ENTRY *pCopy)
+{
+#if USE_LOCKLESS_HASH
+	// read each word exactly once -- if another thread wrote the entry between the two reads, the
+	// stored key will not decode to this signature and the probe simply misses
+	volatile unsigned long long *pWords = pEntry->l;
+
+	pCopy->l[1] = pWords[1];
+	pCopy->l[0] = pWords[0] ^ pCopy->l[1];
+#else
+	*pCopy = *pEntry;
+#endif
+}
+
+/*========================================================================
+** ProbeHash - probes the transposition table for a matching entry, which
+** is returned in heCopy -- the one in the table can be overwritten at any
+** time by another thread, or by the searches of this node's children
+**========================================================================
+*/
+HASH_ENTRY *ProbeHash(PosSignature dwSignature, HASH_ENTRY *heCopy)
 {
     if (HashTable == NULL)
         return(NULL);
 
-    PosSignature	index = dwSignature & (dwHashSize - 1);
-    HASH_ENTRY		*pEntry = HashTable + index;
+    HASH_BUCKET	*pBucket = HashTable + (dwSignature & (dwHashBuckets - 1));
+    unsigned int	dwKey = (unsigned int)(dwSignature >> 32);
+    int			n;
 
 #if LOG_HASH
     if (bLog)
         nHashProbes++;
 #endif
 
-	if ((pEntry->h.dwSignature == dwSignature) /* && (pEntry->h.nDepth >= nDepth) */)
+	// the whole bucket is one cache line, so this is a single miss
+    for (n = 0; n < HASH_BUCKET_SIZE; n++)
     {
+		ReadHashEntry(&pBucket->e[n], heCopy);
+
+		if (heCopy->h.dwKey == dwKey)
+		{
 #if LOG_HASH
-		if (bLog)
-			nHashHits++;
+			if (bLog)
+				nHashHits++;
 #endif
-        return pEntry;
+			return heCopy;
+		}
 	}
-    else
-        return NULL;
+
+	return NULL;
 }
 
 /*========================================================================
 ** SaveHash - saves a move in the hash table if applicable
 **========================================================================
 */
-void SaveHash(CHESSMOVE *cmMove, int nDepth, int nEval, BYTE nFlags, int nPly, PosSignature dwSignature)
+void SaveHash(CHESSMOVE *cmMove, int nDepth, int nEval, int nStaticEval, BYTE nFlags, int nPly, PosSignature dwSignature)
 {
     if (HashTable == NULL)
         return;
@@ -93,61 +128,47 @@ void SaveHash(CHESSMOVE *cmMove, int nDepth, int nEval, BYTE nFlags, int nPly, P
         nHashSaves++;
 #endif
 
-    PosSignature	index = dwSignature & (dwHashSize - 1);
-    HASH_ENTRY		*pEntry = HashTable + index;
+    HASH_BUCKET	*pBucket = HashTable + (dwSignature & (dwHashBuckets - 1));
+    HASH_ENTRY	*pEntry = NULL;
+    HASH_ENTRY	e;
+    unsigned int	dwKey = (unsigned int)(dwSignature >> 32);
+    BYTE		nGeneration = nHashGeneration.load(std::memory_order_relaxed);
+    int			n, nValue, nLowest = INT_MAX;
 
-#if USE_SMP
-	if ((pEntry->h.nDepth <= nDepth) || (nCPUs == 1)/* || pEntry->h.dwSignature == dwSignature */)
-		goto Replace;
-	else
-		return;
-#else
-#if ALWAYS_REPLACE
-    goto Replace;
-#else
-    // ALWAYS REPLACE if depth is equal or larger or if the data is for the same position
-    if ((pEntry->h.nDepth <= nDepth) /* || pEntry->h.dwSignature == dwSignature */)
-        goto Replace;
-	else
-		return;
-#endif
-
-#if 0
-    // stored hash entry is exact (but is for a different position)
-    // stored entry has no move and we have an incoming move
-    if ((pEntry->h.from == NO_SQUARE) && cmMove)
-        goto Replace;
+	for (n = 0; n < HASH_BUCKET_SIZE; n++)
+	{
+		ReadHashEntry(&pBucket->e[n], &e);
 
-    if (pEntry->nFlags & HASH_EXACT)
-    {
-        // replace only if stored entry is not within aging factor of incoming entry
-        if ((pEntry->h.nAge + pEntry->h.nDepth + HASH_AGING_FACTOR) >= (nHashAge + nDepth))
-        {
-#if LOG_HASH
-            if (bLog)
-                nHashBails++;
-#endif
-            return;
-        }
-    }
-    // stored hash entry is upper or lower bound
-    else if ((pEntry->h.nFlags & (HASH_ALPHA | HASH_BETA)) && !(nFlags & HASH_EXACT))
-    {
-        // replace only if stored entry is not within aging factor of incoming entry
-        if ((pEntry->h.nAge + pEntry->h.nDepth + HASH_AGING_FACTOR) >= (nHashAge + nDepth))
-        {
+		// same position -- keep a deeper result from this search unless the new one is exact
+		if (e.h.dwKey == dwKey)
+		{
+			if ((e.h.nGeneration == nGeneration) && (e.h.nDepth > nDepth + HASH_AGING_FACTOR) && !(nFlags & HASH_EXACT))
+			{
 #if LOG_HASH
-            if (bLog)
-                nHashBails++;
+				if (bLog)
+					nHashBails++;
 #endif
-            return;
-        }
-    }
-#endif	// if 0
-#endif	// ALWAYS_REPLACE
+				return;
+			}
+
+			// an entry saved without a static eval keeps the one already stored
+			if (nStaticEval == HASH_NO_STATIC_EVAL)
+				nStaticEval = e.h.nStaticEval;
 
-Replace:
-    if (abs(nEval) >= MATE_THREAT)
+			pEntry = &pBucket->e[n];
+			break;
+		}
+
+		// otherwise replace the shallowest entry, counting entries from older searches as shallower
+		nValue = e.h.nDepth - HASH_AGING_FACTOR * (BYTE)(nGeneration - e.h.nGeneration);
+		if (nValue < nLowest)
+		{
+			nLowest = nValue;
+			pEntry = &pBucket->e[n];
+		}
+	}
+
+	if (abs(nEval) >= MATE_THREAT)
     {
         if (nEval > 0)
             nEval += nPly;
@@ -155,33 +176,60 @@ Replace:
             nEval -= nPly;
     }
 
-//   HASH_ENTRY e;
-
-#if USE_INTERLOCKED
-    _InterlockedExchange64((volatile LONG64 *)&pEntry->h.dwSignature, dwSignature); // 8 byte atomic assignment of signature
-#else
-	pEntry->h.dwSignature = dwSignature;
-#endif
-
-    pEntry->h.nDepth = (BYTE)nDepth;
-	pEntry->h.nEval = (short)nEval;
-	pEntry->h.nFlags = nFlags;
+	e.l[0] = e.l[1] = 0;
+	e.h.dwKey = dwKey;
+	e.h.nGeneration = nGeneration;
+	e.h.nStaticEval = (short)nStaticEval;
+	e.h.nDepth = (BYTE)nDepth;
+	e.h.nEval = (short)nEval;
+	e.h.nFlags = nFlags;
     if (cmMove)
     {
-		pEntry->h.moveflag = cmMove->moveflag;
-		pEntry->h.from = cmMove->fsquare;
-		pEntry->h.to = cmMove->tsquare;
+		e.h.moveflag = cmMove->moveflag;
+		e.h.from = cmMove->fsquare;
+		e.h.to = cmMove->tsquare;
     }
     else
-		pEntry->h.from = NO_SQUARE;
+		e.h.from = NO_SQUARE;
 
-#if USE_INTERLOCKED
-    _InterlockedExchange64((volatile LONG64 *)&pEntry->l[1] , e.l[1]); // 8 byte atomic assignment of all hash items except signature
+#if USE_LOCKLESS_HASH
+	// two plain 8 byte stores, no locks -- the key only matches the data it was written with
+	volatile unsigned long long *pWords = pEntry->l;
+
+	pWords[0] = e.l[0] ^ e.l[1];
+	pWords[1] = e.l[1];
 #else
-//	pEntry->l[1] = e.l[1];
+	*pEntry = e;
 #endif
 }
 
+/*========================================================================
+** PrefetchHash - starts loading the transposition table bucket and the
+** eval hash entry for a position that is about to be searched, so the
+** cache misses overlap with the work done before probing them
+**========================================================================
+*/
+void PrefetchHash(PosSignature dwSignature)
+{
+    if (HashTable)
+        _mm_prefetch((const char *)(HashTable + (dwSignature & (dwHashBuckets - 1))), _MM_HINT_T0);
+
+#if USE_EVAL_HASH
+    if (EvalHashTable)
+        _mm_prefetch((const char *)(EvalHashTable + (dwSignature & (dwThreadEvalHashSize - 1))), _MM_HINT_T0);
+#endif
+}
+
+/*========================================================================
+** NewHashGeneration - ages every entry in the transposition table by one
+** search, so entries from earlier moves can be replaced
+**========================================================================
+*/
+void NewHashGeneration(void)
+{
+	nHashGeneration.fetch_add(1, std::memory_order_relaxed);
+}
+
 #if USE_EVAL_HASH
 /*========================================================================
 ** ProbeEvalHash - probes the eval hash table for a matching entry
@@ -196,7 +244,7 @@ EVAL_HASH_ENTRY *	ProbeEvalHash(PosSignature dwSignature)
     nEvalHashProbes++;
 #endif
 
-    PosSignature	index = dwSignature & (dwEvalHashSize - 1);
+    PosSignature	index = dwSignature & (dwThreadEvalHashSize - 1);
     EVAL_HASH_ENTRY *pEntry = EvalHashTable + index;
 
     if (pEntry->dwSignature == dwSignature)
@@ -219,7 +267,7 @@ void SaveEvalHash(int nEval, PosSignature dwSignature)
     if (EvalHashTable == NULL)
         return;
 
-    PosSignature	index = dwSignature & (dwEvalHashSize - 1);
+    PosSignature	index = dwSignature & (dwThreadEvalHashSize - 1);
     EVAL_HASH_ENTRY *pEntry = EvalHashTable + index;
 
     if (pEntry->dwSignature != dwSignature)
@@ -227,205 +275,215 @@ void SaveEvalHash(int nEval, PosSignature dwSignature)
 #if 0 // LOG_HASH
         nEvalHashSaves++;
 #endif
-#if USE_INTERLOCKED
-        _InterlockedExchange64((volatile LONG64 *)&pEntry->nEval,  (long long) nEval);
-        _InterlockedExchange64((volatile LONG64 *)&pEntry->dwSignature , dwSignature);
-#else
 		pEntry->nEval = (short)nEval;
 		pEntry->dwSignature = dwSignature;
-#endif
     }
 #if 0 // LOG_HASH
     else
         nEvalHashBails++;
 #endif
 }
+
+/*========================================================================
+** SetEvalHashThread - points the calling thread at its own eval hash
+**========================================================================
+*/
+void SetEvalHashThread(int nThread)
+{
+    EvalHashTable = EvalHashTables[nThread];
+}
 #endif	// USE_EVAL_HASH
 
 #if USE_HASH
 /*========================================================================
-** ClearHash - clears the hash table
+** EnableLargePages - asks Windows for the "lock pages in memory"
+** privilege, which large page allocations require
 **========================================================================
 */
-void ClearHash(void)
+static BOOL EnableLargePages(void)
 {
-#if USE_SMP
-    if (bSlave)
-        return;
-#endif
-	
-	if (HashTable == NULL)
-        return;
+#if USE_LARGE_PAGES
+    static int	nEnabled = -1;
+    HANDLE		hToken;
+    TOKEN_PRIVILEGES tp;
 
-    memset(HashTable, 0, sizeof(HASH_ENTRY) * dwHashSize);
+    if (nEnabled >= 0)
+        return(nEnabled);
 
-#if USE_EVAL_HASH
-    if (EvalHashTable)
-        memset(EvalHashTable, 0, sizeof(EVAL_HASH_ENTRY) * dwEvalHashSize);
+    nEnabled = FALSE;
+    if ((GetLargePageMinimum() == 0) || !OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &hToken))
+        return(nEnabled);
+
+    if (LookupPrivilegeValue(NULL, SE_LOCK_MEMORY_NAME, &tp.Privileges[0].Luid))
+    {
+        tp.PrivilegeCount = 1;
+        tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+        // AdjustTokenPrivileges succeeds even if the privilege was not granted, so check the error too
+        if (AdjustTokenPrivileges(hToken, FALSE, &tp, 0, NULL, NULL) && (GetLastError() == ERROR_SUCCESS))
+            nEnabled = TRUE;
+    }
+    CloseHandle(hToken);
+
+    return(nEnabled);
+#else
+    return(FALSE);
 #endif
 }
 
 /*========================================================================
-** InitHash - allocates the hash tables
+** AllocHashMemory - allocates page-aligned memory for a hash table,
+** using large pages if possible and falling back to normal pages
 **========================================================================
 */
-HASH_ENTRY* InitHash(void)
+static void *AllocHashMemory(size_t dwBytes, BOOL *bLargePages)
 {
-    if (!bSlave)
+    void	*pMemory = NULL;
+
+    *bLargePages = FALSE;
+    if (EnableLargePages())
     {
-#if 0
-        printf("# allocating hash table of %lld (%dMB) size\n", dwHashSize * sizeof(HASH_ENTRY),
-               (dwHashSize * sizeof(HASH_ENTRY)) >> 20);
-#endif
+        size_t	dwPageSize = GetLargePageMinimum();
 
-#if !USE_SMP
-        if (bLog)
-            fprintf(logfile, "allocating hash table of %ld (%dMB) size, each entry is %d bytes\n", dwHashSize * sizeof(HASH_ENTRY),
-                    (dwHashSize * sizeof(HASH_ENTRY)) >> 20, sizeof(HASH_ENTRY));
+        pMemory = VirtualAlloc(NULL, (dwBytes + dwPageSize - 1) & ~(dwPageSize - 1), MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (pMemory)
+            *bLargePages = TRUE;
+    }
 
-        HashTable = (HASH_ENTRY *)malloc(dwHashSize * sizeof(HASH_ENTRY));
+    if (pMemory == NULL)
+        pMemory = VirtualAlloc(NULL, dwBytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
 
-#if USE_EVAL_HASH
-        if (bLog)
-            fprintf(logfile, "allocating eval hash table of %ld (%dMB) size, each entry is %d bytes\n", dwEvalHashSize * sizeof(EVAL_HASH_ENTRY),
-                    (dwEvalHashSize * sizeof(EVAL_HASH_ENTRY)) >> 20, sizeof(EVAL_HASH_ENTRY));
+    return(pMemory);
+}
 
-        EvalHashTable = (EVAL_HASH_ENTRY *)malloc(dwEvalHashSize * sizeof(EVAL_HASH_ENTRY));
-#endif
+/*========================================================================
+** ClearHashThread - clears one slice of the transposition table and every
+** nThreads-th eval hash, on a thread bound to the given NUMA node. Windows
+** backs a page of a normal MEM_COMMIT allocation on the node of the thread
+** that first touches it, so the first clear after InitHash spreads those
+** tables over the nodes -- large pages are backed when allocated, and
+** later clears touch pages that already have their memory
+**========================================================================
+*/
+static void ClearHashThread(int nThread, int nThreads, int nNumaNode)
+{
+    size_t	dwFirst = dwHashBuckets * nThread / nThreads;
+    size_t	dwLast = dwHashBuckets * (nThread + 1) / nThreads;
+
+    if (nNumaNode >= 0)
+    {
+        GROUP_AFFINITY	ga;
 
-        if (HashTable)
-            ClearHash();
-#endif	// !USE_SMP
+        if (GetNumaNodeProcessorMaskEx((USHORT)nNumaNode, &ga))
+            SetThreadGroupAffinity(GetCurrentThread(), &ga, NULL);
     }
 
-#if USE_SMP
-    typedef  union  hilo {
-        unsigned long a[2];
-        unsigned long long b;
-    } hilo;
+    memset(HashTable + dwFirst, 0, sizeof(HASH_BUCKET) * (dwLast - dwFirst));
 
-	_timeb tb;
+#if USE_EVAL_HASH
+    int	n;
 
-	_ftime(&tb);
-	srand(tb.time);
-	if (!bSlave)
+    for (n = nThread; n < MAX_CPUS; n += nThreads)
     {
-		// create shared memory for slave processes (even if they're aren't any, because of the "cores" command)
-		hilo h={0};
-   		h.b = dwHashSize * sizeof (HASH_ENTRY) + dwEvalHashSize * sizeof (EVAL_HASH_ENTRY);
-
-		sprintf(szSharedHashName, "MSH-%lld-%d-08X", (long long)tb.time, tb.millitm, GetCurrentProcessId());
-		sprintf(szSharedMemName, "MSM-%lld-%d-08X", (long long)tb.time, tb.millitm, GetCurrentProcessId());
-		hSharedHash = CreateFileMapping(
-							INVALID_HANDLE_VALUE,    // use paging file
-							NULL,                    // default security
-							PAGE_READWRITE,          // read/write access
-							h.a[1],   // maximum object size (high-order DWORD)
-							h.a[0],  // maximum object size (low-order DWORD)
-							szSharedHashName);       // name of mapping object
-
-		if (hSharedHash != NULL)
-		{
-			HashTable = (HASH_ENTRY *)MapViewOfFile(hSharedHash,   // handle to map object
-													FILE_MAP_ALL_ACCESS, // read/write permission
-													0,
-													0,
-													0);
-
-			EvalHashTable = (EVAL_HASH_ENTRY *) ((char *) HashTable + dwHashSize * sizeof (HASH_ENTRY));
-#if DEBUG_SMP
-			printf("Master says hash = %08X, eval = %08X\n", &HashTable, &EvalHashTable);
+        if (EvalHashTables[n])
+            memset(EvalHashTables[n], 0, sizeof(EVAL_HASH_ENTRY) * dwThreadEvalHashSize);
+    }
 #endif
-			if (HashTable)
-				ClearHash();
-		}
-		else
-		{
-			printf("Unable to create hSharedHash - %d\n", (int)GetLastError());
-			fflush(stdout);
-			return(NULL);
-		}
+}
 
-		hSharedMem = CreateFileMapping(
-							INVALID_HANDLE_VALUE,    // use paging file
-							NULL,                    // default security
-							PAGE_READWRITE,          // read/write access
-							0,                       // maximum object size (high-order DWORD)
-							sizeof(SHARED_MEM),     // maximum object size (low-order DWORD)
-							szSharedMemName);       // name of mapping object
+/*========================================================================
+** ClearHash - clears the hash tables, splitting the work between as many
+** threads as there are search threads, which are spread over the NUMA
+** nodes when some table is in normal pages
+**========================================================================
+*/
+void ClearHash(void)
+{
+	if (HashTable == NULL)
+        return;
 
-		if (hSharedMem != NULL)
-		{
-			smSharedMem = (PSHARED_MEM) MapViewOfFile(hSharedMem,   // handle to map object
-							FILE_MAP_ALL_ACCESS, // read/write permission
-							0,
-							0,
-							sizeof(SHARED_MEM));
-
-#if DEBUG_SMP
-			if (smSharedMem != NULL)
-				printf("Master says Shared Mem = %08X\n", &smSharedMem);
-#endif
-		}
-		else
-		{
-			printf("Unable to create hSharedMem - %d\n", (int)GetLastError());
-			fflush(stdout);
-			return(NULL);
-		}
-    }
-    else if (bSlave)
+    ULONG	nHighestNode = 0;
+    int		n, nThreads = nCPUs;
+
+    if (!bNormalPages || !GetNumaHighestNodeNumber(&nHighestNode))
+        nHighestNode = 0;
+
+    if (nThreads > 1)
     {
-        hSharedHash = OpenFileMapping(
-                          FILE_MAP_ALL_ACCESS,   // read/write access
-                          FALSE,                 // do not inherit the name
-                          szSharedHashName);     // name of mapping object
+        std::thread	tClear[MAX_CPUS];
 
-        if (hSharedHash != NULL)
-        {
-            HashTable = (HASH_ENTRY *)MapViewOfFile(hSharedHash, // handle to map object
-                                                    FILE_MAP_ALL_ACCESS,  // read/write permission
-                                                    0,
-                                                    0,
-                                                    dwHashSize * sizeof (HASH_ENTRY) + dwEvalHashSize * sizeof (EVAL_HASH_ENTRY));
-
-            EvalHashTable = (EVAL_HASH_ENTRY *) ((char *) HashTable + dwHashSize * sizeof (HASH_ENTRY));
-
-#if DEBUG_SMP
-            if (HashTable == NULL)
-                printf("Could not map view of file (%s).\n", szSharedHashName);
-            else
-			{
-                printf("Slave says hash = %08X, shared eval = %08X\n", &HashTable, &EvalHashTable);
-				printf("Slave says it is number %d\n", nSlaveNum);
-			}
-#endif
-        }
+        for (n = 1; n < nThreads; n++)
+            tClear[n] = std::thread(ClearHashThread, n, nThreads, nHighestNode ? (int)(n % (nHighestNode + 1)) : -1);
+        ClearHashThread(0, nThreads, -1);	// the main thread is left unbound
+        for (n = 1; n < nThreads; n++)
+            tClear[n].join();
+    }
+    else
+        ClearHashThread(0, 1, -1);
 
-        hSharedMem = OpenFileMapping(
-                         FILE_MAP_ALL_ACCESS,   // read/write access
-                         FALSE,                 // do not inherit the name
-                         szSharedMemName);     // name of mapping object
+    nHashGeneration.store(0, std::memory_order_relaxed);
+}
 
-        if (hSharedMem != NULL)
-        {
-            smSharedMem = (PSHARED_MEM)MapViewOfFile(hSharedMem, // handle to map object
-                          FILE_MAP_ALL_ACCESS,  // read/write permission
-                          0,
-                          0,
-                          sizeof(SHARED_MEM));
-
-			ZeroMemory(&smSharedMem->sdSlaveData[nSlaveNum], sizeof(SLAVE_DATA));
-
-#if DEBUG_SMP
-            if (smSharedMem == NULL)
-                printf("Could not map view of file (%s).\n", szSharedMemName);
-            else
-                printf("Slave says SharedMem = %08X\n", &smSharedMem);
+/*========================================================================
+** InitHash - allocates the hash tables
+**========================================================================
+*/
+HASH_BUCKET* InitHash(void)
+{
+    BOOL	bLargePages;
+    int		nLargePageKB = (int)(GetLargePageMinimum() >> 10);
+
+#if 0
+    printf("# allocating hash table of %lld (%dMB) size\n", dwHashSize * sizeof(HASH_ENTRY),
+           (dwHashSize * sizeof(HASH_ENTRY)) >> 20);
 #endif
-        }
+
+    if (bLog)
+        fprintf(logfile, "allocating hash table of %ld (%dMB) size, each entry is %d bytes\n", dwHashSize * sizeof(HASH_ENTRY),
+                (dwHashSize * sizeof(HASH_ENTRY)) >> 20, sizeof(HASH_ENTRY));
+
+    // pages are aligned, so every bucket starts on a cache line and probing one costs a single miss
+    dwHashBuckets = dwHashSize / HASH_BUCKET_SIZE;
+    HashTable = (HASH_BUCKET *)AllocHashMemory(dwHashBuckets * sizeof(HASH_BUCKET), &bLargePages);
+    bNormalPages = !bLargePages;
+
+    if (bLog)
+    {
+        if (bLargePages)
+            fprintf(logfile, "hash table uses large (%dKB) pages\n", nLargePageKB);
+        else
+            fprintf(logfile, "hash table uses normal pages\n");
+    }
+
+#if USE_EVAL_HASH
+    int	n, nLargeTables = 0;
+
+    // the eval hash is not shared, so split it between the search threads, keeping each table a power of 2
+    dwThreadEvalHashSize = dwEvalHashSize;
+    while ((dwThreadEvalHashSize * nCPUs > dwEvalHashSize) && (dwThreadEvalHashSize > MIN_THREAD_EVAL_HASH_SIZE))
+        dwThreadEvalHashSize >>= 1;
+
+    if (bLog)
+        fprintf(logfile, "allocating %d eval hash table(s) of %ld (%dMB) size, each entry is %d bytes\n", nCPUs, dwThreadEvalHashSize * sizeof(EVAL_HASH_ENTRY),
+                (dwThreadEvalHashSize * sizeof(EVAL_HASH_ENTRY)) >> 20, sizeof(EVAL_HASH_ENTRY));
+
+    for (n = 0; n < nCPUs; n++)
+    {
+        EvalHashTables[n] = (EVAL_HASH_ENTRY *)AllocHashMemory(dwThreadEvalHashSize * sizeof(EVAL_HASH_ENTRY), &bLargePages);
+        if (EvalHashTables[n] && bLargePages)
+            nLargeTables++;
+        else if (EvalHashTables[n])
+            bNormalPages = TRUE;
     }
-#endif	// USE_SMP
+
+    if (bLog)
+        fprintf(logfile, "%d of %d eval hash table(s) use large (%dKB) pages, the others normal pages\n", nLargeTables, nCPUs, nLargePageKB);
+
+    SetEvalHashThread(0);
+#endif
+
+    if (HashTable)
+        ClearHash();	// also places the normal pages on the NUMA nodes
 
     return(HashTable);
 }
@@ -439,11 +497,6 @@ void CloseHash(void)
     if (HashTable == NULL)
         return;
 
-#if USE_SMP
-    if (bSlave)
-        return;
-#endif
-
 #if LOG_HASH
     if (bLog)
     {
@@ -452,20 +505,282 @@ void CloseHash(void)
     }
 #endif
 
-#if USE_SMP
-	UnmapViewOfFile(smSharedMem);
-	UnmapViewOfFile(HashTable);
-	if (hSharedMem)
-		CloseHandle(hSharedMem);
-	if (hSharedHash)
-		CloseHandle(hSharedHash);
+    VirtualFree(HashTable, 0, MEM_RELEASE);
+    HashTable = NULL;
+
+#if USE_EVAL_HASH
+    int	n;
+
+    for (n = 0; n < MAX_CPUS; n++)
+    {
+        if (EvalHashTables[n])
+            VirtualFree(EvalHashTables[n], 0, MEM_RELEASE);
+        EvalHashTables[n] = NULL;
+    }
+    EvalHashTable = NULL;
+#endif
+}
+
+#define HASH_FILE_VERSION	3				// bump whenever HASH_ENTRY, HASH_BUCKET or HASH_FILE_HEADER changes
+#define HASH_FILE_CHUNK		(0x4000000)		// read and write in 64MB pieces
+
+typedef struct
+{
+    char		szMagic[8];			// "MYRDHASH"
+    int			nVersion;
+    int			nEntrySize;
+    int			nBucketSize;
+    int			bLockless;			// entries are stored with the XOR encoding
+    int			nGeneration;
+    int			nEvalTables;		// 0 if the eval hash was not saved
+    int			nEvalEntrySize;
+    unsigned int	dwNetChecksum;		// network that computed the evals in the tables
+    unsigned long long	dwHashSize;
+    unsigned long long	dwEvalHashSize;	// entries in each eval table
+} HASH_FILE_HEADER;
+
+BOOL	bHashLoaded = FALSE;	// don't clear the table loaded by LoadHashFile on the next analyze
+
+/*========================================================================
+** NetChecksum - identifies the network whose evals are in the hash tables
+**========================================================================
+*/
+static unsigned int NetChecksum(void)
+{
+#if USE_CEREBRUM_1_0
+    return(0);
 #else
-    free(HashTable);
+    return(nn_checksum());
+#endif
+}
+
+/*========================================================================
+** HashFileData - reads or writes one table of a hash file in chunks
+**========================================================================
+*/
+static BOOL HashFileData(FILE *fp, void *pData, size_t dwBytes, BOOL bWrite)
+{
+    char	*p = (char *)pData;
+    size_t	dwChunk;
+
+    while (dwBytes)
+    {
+        dwChunk = min(dwBytes, (size_t)HASH_FILE_CHUNK);
+        if ((bWrite ? fwrite(p, 1, dwChunk, fp) : fread(p, 1, dwChunk, fp)) != dwChunk)
+            return(FALSE);
+        p += dwChunk;
+        dwBytes -= dwChunk;
+    }
+
+    return(TRUE);
+}
+
+/*========================================================================
+** SaveHashFile - writes the transposition table, and optionally the eval
+** hash tables, to a file that LoadHashFile can read back. The tables are
+** stored raw after the header, so loading is one sequential read. The
+** eval hash must only be saved while no search is running, as its
+** entries, unlike those of the transposition table, can be torn.
+**========================================================================
+*/
+BOOL SaveHashFile(char *szFile, BOOL bEval)
+{
+    HASH_FILE_HEADER	hfh;
+    FILE				*fp;
+    BOOL				bOK;
+    int					n;
+
+    if (HashTable == NULL)
+        return(FALSE);
+
+    fp = fopen(szFile, "wb");
+    if (fp == NULL)
+        return(FALSE);
+
+    memset(&hfh, 0, sizeof(hfh));
+    memcpy(hfh.szMagic, "MYRDHASH", sizeof(hfh.szMagic));
+    hfh.nVersion = HASH_FILE_VERSION;
+    hfh.nEntrySize = sizeof(HASH_ENTRY);
+    hfh.nBucketSize = HASH_BUCKET_SIZE;
+    hfh.bLockless = USE_LOCKLESS_HASH;
+    hfh.nGeneration = nHashGeneration.load(std::memory_order_relaxed);
+    hfh.dwNetChecksum = NetChecksum();
+    hfh.dwHashSize = dwHashSize;
+#if USE_EVAL_HASH
+    if (bEval)
+    {
+        hfh.nEvalTables = nCPUs;
+        hfh.nEvalEntrySize = sizeof(EVAL_HASH_ENTRY);
+        hfh.dwEvalHashSize = dwThreadEvalHashSize;
+    }
+#endif
+
+    bOK = (fwrite(&hfh, sizeof(hfh), 1, fp) == 1) && HashFileData(fp, HashTable, dwHashBuckets * sizeof(HASH_BUCKET), TRUE);
 
 #if USE_EVAL_HASH
-    free(EvalHashTable);
+    for (n = 0; bOK && (n < hfh.nEvalTables); n++)
+        bOK = HashFileData(fp, EvalHashTables[n], dwThreadEvalHashSize * sizeof(EVAL_HASH_ENTRY), TRUE);
 #endif
+
+    if (fclose(fp))
+        bOK = FALSE;
+
+    if (bLog)
+        fprintf(logfile, "saving hash file %s %s\n", szFile, bOK ? "succeeded" : "failed");
+
+    return(bOK);
+}
+
+/*========================================================================
+** LoadHashFile - reads a file written by SaveHashFile back into the hash
+** tables, which must be the same size as when the file was saved, and
+** scored by the same network
+**========================================================================
+*/
+BOOL LoadHashFile(char *szFile)
+{
+    HASH_FILE_HEADER	hfh;
+    FILE				*fp;
+    BOOL				bOK;
+    int					n;
+
+    if (HashTable == NULL)
+        return(FALSE);
+
+    fp = fopen(szFile, "rb");
+    if (fp == NULL)
+        return(FALSE);
+
+    bOK = (fread(&hfh, sizeof(hfh), 1, fp) == 1) && !memcmp(hfh.szMagic, "MYRDHASH", sizeof(hfh.szMagic)) &&
+          (hfh.nVersion == HASH_FILE_VERSION) && (hfh.nEntrySize == sizeof(HASH_ENTRY)) && (hfh.nBucketSize == HASH_BUCKET_SIZE) &&
+          (hfh.bLockless == USE_LOCKLESS_HASH) && (hfh.dwHashSize == dwHashSize) && (hfh.dwNetChecksum == NetChecksum());
+
+    if (bOK)
+    {
+        bOK = HashFileData(fp, HashTable, dwHashBuckets * sizeof(HASH_BUCKET), FALSE);
+        if (bOK)
+            nHashGeneration.store((BYTE)hfh.nGeneration, std::memory_order_relaxed);
+        else
+            ClearHash();	// don't search with half a table
+    }
+
+#if USE_EVAL_HASH
+    // the eval hash is only a cache, so it is simply skipped if the thread count or size has changed since it was saved
+    if (bOK && (hfh.nEvalTables == nCPUs) && (hfh.nEvalEntrySize == sizeof(EVAL_HASH_ENTRY)) && (hfh.dwEvalHashSize == dwThreadEvalHashSize))
+    {
+        for (n = 0; n < hfh.nEvalTables; n++)
+        {
+            if (!HashFileData(fp, EvalHashTables[n], dwThreadEvalHashSize * sizeof(EVAL_HASH_ENTRY), FALSE))
+            {
+                memset(EvalHashTables[n], 0, sizeof(EVAL_HASH_ENTRY) * dwThreadEvalHashSize);
+                break;
+            }
+        }
+    }
 #endif
+
+    fclose(fp);
+
+    if (bLog)
+        fprintf(logfile, "loading hash file %s %s\n", szFile, bOK ? "succeeded" : "failed");
+
+    bHashLoaded = bOK;
+    return(bOK);
+}
+
+#define STRESS_KEYS		(0x10000)	// distinct positions used by the stress test
+#define STRESS_SLOTS	(0x100)		// ...all crammed into this many table buckets
+
+/*========================================================================
+** StressSignature - signature and hash data for stress test key n, so
+** that any entry found in the table can be checked against its key
+**========================================================================
+*/
+static PosSignature StressSignature(unsigned int n, CHESSMOVE *cmMove, int *nEval, BYTE *nFlags)
+{
+	PosSignature	x = ((PosSignature)n + 1) * 0x9E3779B97F4A7C15ULL;	// splitmix64
+
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	x ^= x >> 31;
+
+	cmMove->fsquare = (SquareType)(x & 63);
+	cmMove->tsquare = (SquareType)((x >> 6) & 63);
+	cmMove->moveflag = (MoveFlagType)(x >> 12);
+	*nEval = (int)((x >> 28) % 4000) - 2000;
+	*nFlags = (BYTE)(HASH_ALPHA << ((x >> 40) % 3));
+
+	return((x & ~(PosSignature)(dwHashBuckets - 1)) | (n % STRESS_SLOTS));
+}
+
+/*========================================================================
+** StressThread - one thread of the stress test, randomly saving and
+** probing stress test keys and counting any entry that doesn't match
+**========================================================================
+*/
+static void StressThread(int nThread, int nProbes, std::atomic<int> *nHits, std::atomic<int> *nCorrupt)
+{
+	unsigned int	nRand = 0x2545F491 * (nThread + 1);
+	int				n, nEval, nHashEval, nMyHits = 0, nMyCorrupt = 0;
+	BYTE			nFlags;
+	CHESSMOVE		cmMove;
+	PosSignature	dwSignature;
+	HASH_ENTRY		heEntry, *heHash;
+
+	for (n = 0; n < nProbes; n++)
+	{
+		nRand ^= nRand << 13;	// xorshift32
+		nRand ^= nRand >> 17;
+		nRand ^= nRand << 5;
+
+		dwSignature = StressSignature(nRand % STRESS_KEYS, &cmMove, &nEval, &nFlags);
+
+		if (nRand & 0x80000000)
+		{
+			SaveHash(&cmMove, 1, nEval, nEval, nFlags, 0, dwSignature);
+			continue;
+		}
+
+		heHash = ProbeHash(dwSignature, &heEntry);
+		if (heHash == NULL)
+			continue;
+
+		nMyHits++;
+		nHashEval = heHash->h.nEval;
+		if ((nHashEval != nEval) || (heHash->h.nStaticEval != nEval) || (heHash->h.nFlags != nFlags) || (heHash->h.nDepth != 1) ||
+			(heHash->h.from != cmMove.fsquare) || (heHash->h.to != cmMove.tsquare) || (heHash->h.moveflag != cmMove.moveflag))
+			nMyCorrupt++;
+	}
+
+	*nHits += nMyHits;
+	*nCorrupt += nMyCorrupt;
+}
+
+/*========================================================================
+** HashStressTest - hammers one small region of the transposition table
+** from many threads at once and returns the number of corrupt entries
+** that were returned by ProbeHash
+**========================================================================
+*/
+int HashStressTest(int nThreads, int nProbes)
+{
+	std::thread			tStress[MAX_CPUS];
+	std::atomic<int>	nHits(0), nCorrupt(0);
+	int					n;
+
+	if ((HashTable == NULL) || (dwHashBuckets < STRESS_SLOTS))
+		return(0);
+
+	for (n = 0; n < nThreads; n++)
+		tStress[n] = std::thread(StressThread, n, nProbes, &nHits, &nCorrupt);
+	for (n = 0; n < nThreads; n++)
+		tStress[n].join();
+
+	printf("%d threads, %d probes each, %d hits, %d corrupt\n", nThreads, nProbes, nHits.load(), nCorrupt.load());
+
+	ClearHash();
+
+	return(nCorrupt);
 }
 #endif	// USE_HASH
 
@@ -19,7 +19,10 @@ along with this program.If not, see < https://www.gnu.org/licenses/>.
 #pragma pack(push,1)
 typedef struct
 {
-    PosSignature	dwSignature;
+    unsigned int	dwKey;			// upper half of the signature, the lower half picks the bucket
+    BYTE			nGeneration;	// search that wrote the entry, for aging
+    short			nStaticEval;	// BBEvaluate() of the position, or HASH_NO_STATIC_EVAL
+    BYTE			nUnused;
     short			nEval;
     MoveFlagType	moveflag;
     BYTE			nFlags;
@@ -30,7 +33,7 @@ typedef struct
 
 typedef union {
 	hash_item h;
-//	long long  l[2];
+	unsigned long long  l[2];	// l[0] is the key and generation, l[1] is everything else
 } HASH_ENTRY;
 
 typedef struct
@@ -40,6 +43,13 @@ typedef struct
 } EVAL_HASH_ENTRY;
 #pragma pack(pop)
 
+#define HASH_BUCKET_SIZE	4	// entries per bucket, one 64 byte cache line
+
+typedef struct alignas(64)
+{
+    HASH_ENTRY		e[HASH_BUCKET_SIZE];
+} HASH_BUCKET;
+
 #define DEFAULT_HASH_SIZE		(0x1000000)	// 256MB
 
 #define HASH_NOT_EVAL		(0x00)
@@ -48,17 +58,28 @@ typedef struct
 #define HASH_EXACT			(0x40)
 #define HASH_MATE_THREAT	(0x01)
 
+#define HASH_NO_STATIC_EVAL	(-MAX_WINDOW)
+
 extern size_t	dwHashSize;
 extern size_t	dwEvalHashSize;
+extern size_t	dwThreadEvalHashSize;
 
-HASH_ENTRY *InitHash(void);
+HASH_BUCKET *InitHash(void);
 void		ClearHash(void);
 void		CloseHash(void);
+void		NewHashGeneration(void);
+BOOL		SaveHashFile(char *szFile, BOOL bEval);
+BOOL		LoadHashFile(char *szFile);
+
+extern BOOL	bHashLoaded;
 
-void		SaveHash(CHESSMOVE *cmMove, int nDepth, int nEval, BYTE nFlags, int nPly, PosSignature dwSignature);
-HASH_ENTRY *ProbeHash(PosSignature dwSignature);
+void		SaveHash(CHESSMOVE *cmMove, int nDepth, int nEval, int nStaticEval, BYTE nFlags, int nPly, PosSignature dwSignature);
+HASH_ENTRY *ProbeHash(PosSignature dwSignature, HASH_ENTRY *heCopy);
+void		PrefetchHash(PosSignature dwSignature);
+int			HashStressTest(int nThreads, int nProbes);
 
 extern void SaveEvalHash(int nEval, PosSignature dwSignature);
 extern EVAL_HASH_ENTRY *ProbeEvalHash(PosSignature dwSignature);
+extern void SetEvalHashThread(int nThread);
 
 PosSignature	GetBBSignature(BB_BOARD *bbBoard);
@@ -49,9 +49,44 @@ along with this program.If not, see < https://www.gnu.org/licenses/>.
 
 #define	 MAX_HISTORY_VAL	0x0FFFFF
 
-void			BBGenerateAllMoves(BB_BOARD *Board, CHESSMOVE *legal_move_list, WORD *next_move, BOOL CapturesOnly);
+////////////////////////////////////////////////////////////////////////////////
+// PACKEDMOVE layout -- bits 0-5 from square, 6-11 to square, 12-13 promoted
+// piece (QUEEN to KNIGHT), 14-15 special move type. Captures are not flagged,
+// they are found from the board when the move is unpacked
+#define PM_NORMAL		0x0000
+#define PM_PROMOTION	0x4000
+#define PM_ENPASSANT	0x8000
+#define PM_CASTLE		0xC000
+#define PM_SPECIALMASK	0xC000
+#define NO_PACKEDMOVE	0		// a8 to a8
+
+#define PM_FROM(pm)		((SquareType)((pm) & 0x3F))
+#define PM_TO(pm)		((SquareType)(((pm) >> 6) & 0x3F))
+#define PM_SQUARES(pm)	((pm) & 0x0FFF)
+#define PM_PROMOTED(pm)	((PieceType)((((pm) >> 12) & 0x03) + FIRST_PROMOTE))
+#define PM_SPECIAL(pm)	((pm) & PM_SPECIALMASK)
+
+// generated moves, with their scores kept apart so that sorting never has to touch the moves
+typedef struct
+{
+	WORD		nNumMoves;
+	PACKEDMOVE	pmMoves[MAX_LEGAL_MOVES];
+	int			nScores[MAX_LEGAL_MOVES];
+} MOVELIST;
+
+// move generation types
+#define	GEN_ALL			FALSE
+#define	GEN_CAPTURES	TRUE	// captures and promotions
+#define	GEN_QUIETS		2		// everything else, including castles
+
+void			BBGenerateMoveList(BB_BOARD *Board, MOVELIST *mlMoves, int nGenType);
+void			BBGenerateAllMoves(BB_BOARD *Board, CHESSMOVE *legal_move_list, WORD *next_move, int nGenType);
+BOOL			BBMoveIsLegal(BB_BOARD *Board, PACKEDMOVE pmMove);
+PACKEDMOVE		BBPackMove(SquareType from, SquareType to, MoveFlagType moveflag);
+void			BBUnpackMove(BB_BOARD *Board, PACKEDMOVE pmMove, CHESSMOVE *move);
 int 			BBKingInDanger(BB_BOARD *Board, int whose_king);
 void     		BBMakeMove(CHESSMOVE *move_to_make, BB_BOARD *Board, BOOL bUpdateAcc);
+PosSignature	BBGetMoveSignature(BB_BOARD *Board, CHESSMOVE *move);
 void			BBUnMakeMove(CHESSMOVE *move_to_unmake, BB_BOARD *Board, BOOL bUpdateAcc);
 void			BBMakeNullMove(CHESSMOVE *cmNull, BB_BOARD *Board);
 void			BBUnMakeNullMove(CHESSMOVE *cmNull, BB_BOARD *Board);
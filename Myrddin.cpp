@@ -75,7 +75,6 @@ CHESSMOVE	cmGameMoveList[MAX_MOVE_LIST];
 // initialization file settings
 BOOL 			bLog=FALSE;
 BOOL			bKibitz=FALSE;
-BOOL			bSlave=FALSE;
 int				nCPUs = 1;
 
 #if USE_EGTB
@@ -92,6 +91,9 @@ int				nDepth, nThinkDepth, nPrevPVEval;
 int				nCompSide;
 unsigned int	nThinkTime, nPonderTime, nFischerInc, nLevelMoves, nMovesBeforeControl;
 int				nClockRemaining;	// needs to be signed because it can be temporarily negative when calculating time to think
+#if USE_SMALL_NET
+BOOL			bSmallNet = FALSE;	// a small network is loaded
+#endif
 unsigned int	nCheckNodes, nThinkNodes;
 CHESSMOVE		cmChosenMove, cmPonderMove;
 BB_BOARD		bbPonderRestore;
@@ -103,78 +105,9 @@ FILE		   *logfile;
 char			line[512], command[512];
 int				is_pipe = 0;
 HANDLE			input_handle = 0;
-int				nSlaveNum = -1;
-
-#if USE_SMP
-char			szProgName[MAX_PATH];
-char			szSharedMemName[128], szSharedHashName[128];
-HANDLE			hSharedMem = NULL;
-HANDLE			hSharedHash = NULL;
-SHARED_HASH		*shSharedHash;
-SHARED_MEM		*smSharedMem;
-STARTUPINFO		si;
-PROCESS_INFORMATION	pi[MAX_CPUS];
-#endif
 
 const PieceType	BackRank[BSIZE] = {ROOK, KNIGHT, BISHOP, QUEEN, KING, BISHOP, KNIGHT, ROOK};
 
-#if USE_SMP
-/*========================================================================
-** SendSlavesString -- Sends (forwards) a command string to all slave 
-** processes
-**========================================================================
-*/
-void SendSlavesString(char *szString)
-{
-	int	x;
-	char *c;
-
-	if (nCPUs <= 1)
-		return;
-
-	if (!smSharedMem)
-		return;
-
-	// strip trailing carriage return if there is one
-    c = (char *)strrchr(szString, '\n');
-    if (c)
-        *c = '\0';
-
-#if DEBUG_SMP
-	fprintf(logfile, "Sending slaves -- %s\n", szString);
-#endif
-
-	for (x = 0; x < nCPUs - 1; x++)
-	{
-		if (smSharedMem->sdSlaveData[x].bLocked || (strlen(smSharedMem->sdSlaveData[x].szEngineCommand[smSharedMem->sdSlaveData[x].nNextToSend])))
-			Sleep(10);
-
-		smSharedMem->sdSlaveData[x].bLocked = TRUE;
-		strcpy(smSharedMem->sdSlaveData[x].szEngineCommand[smSharedMem->sdSlaveData[x].nNextToSend], szString);
-		smSharedMem->sdSlaveData[x].nNextToSend = (smSharedMem->sdSlaveData[x].nNextToSend + 1) % NUM_SLAVE_STRINGS;
-		smSharedMem->sdSlaveData[x].bLocked = FALSE;
-	}
-}
-
-/*========================================================================
-** ZeroSlaveNodes -- Clears the number of nodes searched by each process
-**========================================================================
-*/
-void ZeroSlaveNodes(void)
-{
-	int x;
-
-	if (nCPUs <= 1)
-		return;
-
-	if (!smSharedMem)
-		return;
-
-	for (x = 0; x < nCPUs - 1; x++)
-		smSharedMem->sdSlaveData[x].nSearchNodes = 0;
-}
-#endif
-
 /*========================================================================
 ** SetHashSize - set the hash size based on ini file setting or GUI command
 **========================================================================
@@ -189,9 +122,10 @@ void SetHashSize(unsigned int size)	// size in MB
 	while (p > size)
 		p >>= 1;
 
-	// this distribution of the memory allocation will result in about 15% more memory than requested - no big deal
+	// the transposition table gets half of the memory requested, and the eval hash (only needed for qsearch leaves, since
+	// the TT entries hold the static eval) gets another 30% or so
 	dwHashSize = p << 15;	// number of entries in transposition table
-	dwEvalHashSize = dwHashSize * 2;	// number of entries in eval table
+	dwEvalHashSize = dwHashSize;	// number of entries in eval table
 //	printf("size = %d, dwHashSize = %08X, %ld, dwEvalHashSize = %08X, %ld\n", size, dwHashSize, dwHashSize * sizeof(HASH_ENTRY), dwEvalHashSize, dwEvalHashSize * sizeof(EVAL_HASH_ENTRY));
 }
 
@@ -264,13 +198,10 @@ void ParseIniFile(void)
 #if USE_SMP
         else if (strnicmp(command, "cpus=", 5) == 0)
 		{
-            // "cpus" -- number of cpus to use
+            // "cpus" -- number of search threads to use
             nCPUs = atoi(&command[5]);
 			nCPUs = max(nCPUs, 1);
 			nCPUs = min(nCPUs, MAX_CPUS);
-#if DEBUG_SMP
-			printf("Number of CPUS = %d\n", nCPUs);
-#endif
 		}
 #endif
     }
@@ -278,53 +209,6 @@ void ParseIniFile(void)
     fclose(IniFile);
 }
 
-#if USE_SMP
-/*========================================================================
-** ParseCommandline -- Handle commands from the command line
-**========================================================================
-*/
-void ParseCommandline(int argc, char *argv[])
-{
-    int		n = 1;
-	char	command[64]={0};
-
-    while (n < argc)
-    {
-        strcpy(command, argv[n]);
-
-#if DEBUG_SMP
-		printf("command %d is %s\n", n, command);
-#endif
-
-		if (strncmp(command, "sharedmem=", 10) == 0)
-		{
-			// "sharedmem" -- string containing name of shared memory for slave process game management
-			if (bSlave)	// only do this if "slave" has been sent on the commandline first
-				strcpy(szSharedMemName, command+10);
-		}
-		else if (strncmp(command, "sharedhash=", 11) == 0)
-		{
-			// "sharedhash" -- string containing name of shared memory for slave process transposition/eval/pawn hash 
-			if (bSlave)	// only do this if "slave" has been sent on the commandline first
-				strcpy(szSharedHashName, command+11);
-		}
-		else if (strncmp(command, "slave", 5) == 0)
-		{
-			// "slave" -- this is a slave process for SMP
-			bSlave = TRUE;
-		}
-		else if (strncmp(command, "numslave=", 9) == 0)
-		{
-			// "numslave" -- this is the slave process number
-			if (bSlave)	// only do this if "slave" has been sent on the commandline first
-				nSlaveNum = atoi(&command[9]);
-		}
-
-        n++;
-    }
-}
-#endif
-
 /*========================================================================
 ** InitializeInput -- Open the stdin pipe for reading
 **========================================================================
@@ -374,7 +258,7 @@ int IsInputAvailable(void)
 */
 void PromptForInput(void)
 {
-    if (bSlave || bXboard)
+    if (bXboard)
         return;
 
     printf("> ");
@@ -387,43 +271,6 @@ void PromptForInput(void)
 */
 BOOL	CheckForInput(BOOL bWaitForInput)
 {
-#if USE_SMP
-	if (bSlave)
-	{
-		if (bWaitForInput)
-		{
-			while (strlen(smSharedMem->sdSlaveData[nSlaveNum].szEngineCommand[smSharedMem->sdSlaveData[nSlaveNum].nNextToReceive]) == 0 || smSharedMem->sdSlaveData[nSlaveNum].bLocked)
-				Sleep(10);
-		}
-
-		if (strlen(smSharedMem->sdSlaveData[nSlaveNum].szEngineCommand[smSharedMem->sdSlaveData[nSlaveNum].nNextToReceive]) && !smSharedMem->sdSlaveData[nSlaveNum].bLocked)
-		{
-			smSharedMem->sdSlaveData[nSlaveNum].bLocked = TRUE;
-#if DEBUG_SMP
-			printf("slave %d has some input in slot %d -- '%s'\n", nSlaveNum, smSharedMem->sdSlaveData[nSlaveNum].nNextToReceive, 
-				smSharedMem->sdSlaveData[nSlaveNum].szEngineCommand[smSharedMem->sdSlaveData[nSlaveNum].nNextToReceive]);
-			fprintf(logfile, "slave %d has some input in slot %d -- '%s'\n", nSlaveNum, smSharedMem->sdSlaveData[nSlaveNum].nNextToReceive,
-				smSharedMem->sdSlaveData[nSlaveNum].szEngineCommand[smSharedMem->sdSlaveData[nSlaveNum].nNextToReceive]);
-#endif
-			strcpy(line, smSharedMem->sdSlaveData[nSlaveNum].szEngineCommand[smSharedMem->sdSlaveData[nSlaveNum].nNextToReceive]);
-			char *c = strchr(smSharedMem->sdSlaveData[nSlaveNum].szEngineCommand[smSharedMem->sdSlaveData[nSlaveNum].nNextToReceive], ' ');
-			if (c)
-				*c = '\0';
-			strcpy(command, smSharedMem->sdSlaveData[nSlaveNum].szEngineCommand[smSharedMem->sdSlaveData[nSlaveNum].nNextToReceive]);
-			smSharedMem->sdSlaveData[nSlaveNum].szEngineCommand[smSharedMem->sdSlaveData[nSlaveNum].nNextToReceive][0] = '\0';
-			smSharedMem->sdSlaveData[nSlaveNum].nNextToReceive = (smSharedMem->sdSlaveData[nSlaveNum].nNextToReceive + 1) % NUM_SLAVE_STRINGS;
-			smSharedMem->sdSlaveData[nSlaveNum].bLocked = FALSE;
-#if DEBUG_SMP
-			printf("command = %s\n", command);
-			printf("line = %s\n", line);
-#endif
-			return(TRUE);
-		}
-		else
-			return(FALSE);
-	}
-#endif
-
     if (bWaitForInput == FALSE)
     {
         if (!IsInputAvailable())
@@ -517,7 +364,6 @@ void bbNewGame(BB_BOARD *bbBoard)
     int x;
 
 #if USE_HASH
-//	nHashAge = 0;
     ClearHash();
 #endif
 
@@ -669,7 +515,7 @@ void	HandleCommand(void)
         {
             printf("feature done=0\n");
             printf("feature setboard=1 playother=1 draw=0\n");
-            printf("feature sigint=0 sigterm=0 reuse=0 analyze=1 memory=1 nps=1\n");
+            printf("feature sigint=0 sigterm=0 reuse=0 analyze=1 memory=1 nps=1 smp=1\n");
 			printf("feature variants=normal\n");
 			printf("feature myname=\"%s\"\n", szVersion);
 			printf("feature done=1\n");
@@ -716,10 +562,6 @@ void	HandleCommand(void)
 
 	if (!strcmp(command, "new"))
     {
-#if USE_SMP
-		if (!bSlave)
-			SendSlavesString(command);
-#endif
 
         if ((bStoreCommand == FALSE) &&
                 ((nEngineMode == ENGINE_THINKING) || (nEngineMode == ENGINE_ANALYZING) || (nEngineMode == ENGINE_PONDERING)))
@@ -748,10 +590,6 @@ void	HandleCommand(void)
     {
         char   *c;
 
-#if USE_SMP
-		if (!bSlave)
-			SendSlavesString(line);
-#endif
 
         if ((bStoreCommand == FALSE) &&
                 ((nEngineMode == ENGINE_THINKING) || (nEngineMode == ENGINE_ANALYZING) || (nEngineMode == ENGINE_PONDERING)))
@@ -809,9 +647,6 @@ void	HandleCommand(void)
 #if USE_SMP
     if (!strncmp(command, "cores", 5))
 	{
-		if (bSlave)
-			return;
-
         if (nEngineMode == ENGINE_THINKING || nEngineMode == ENGINE_ANALYZING || nEngineMode == ENGINE_PONDERING)
 		{
 			NotHandled();
@@ -819,8 +654,6 @@ void	HandleCommand(void)
 			return;
 		}
 
-		KillProcesses();
-
 		if (command[5] == '=')
 			nCPUs = atoi(&command[6]);
 		else
@@ -830,12 +663,16 @@ void	HandleCommand(void)
 		if (nCPUs > MAX_CPUS)
 			nCPUs = MAX_CPUS;
 
-		StartProcesses(nCPUs);
+#if USE_HASH
+		// each thread has its own eval hash, so the tables have to be reallocated for the new thread count
+		CloseHash();
+		InitHash();
+#endif
 
         if (bLog)
-            fprintf(logfile, "Now using %d processes\n", nCPUs);
+            fprintf(logfile, "Now using %d threads\n", nCPUs);
 
-        printf("Now using %d processes\n\n", nCPUs);
+        printf("Now using %d threads\n\n", nCPUs);
 
         PromptForInput();
         return;
@@ -844,11 +681,6 @@ void	HandleCommand(void)
 
     if (!strcmp(command, "perft"))
     {
-#if USE_SMP
-		if (bSlave)
-			return;
-#endif
-
         int	depth = 0;
         ULONGLONG	starttime;
 
@@ -882,11 +714,6 @@ void	HandleCommand(void)
 
     if (!strcmp(command, "divide"))
     {
-#if USE_SMP
-		if (bSlave)
-			return;
-#endif
-
         int	depth;
         ULONGLONG	starttime;
 
@@ -915,10 +742,6 @@ void	HandleCommand(void)
 
 	if (!strcmp(command, "rpt"))	// run perft test
 	{
-#if USE_SMP
-		if (bSlave)
-			return;
-#endif
 		int x;
 		ULONGLONG alltime, starttime;
 
@@ -949,13 +772,297 @@ void	HandleCommand(void)
 		return;
 	}
 
-    if (!strcmp(command, "eval"))
-    {
-#if USE_SMP
-		if (bSlave)
+#if USE_HASH
+	if (!strcmp(command, "savehash"))	// save the hash tables, can also be used while analyzing
+	{
+		char	szFile[MAX_PATH], szEval[16];
+
+		if ((nEngineMode != ENGINE_IDLE) && (nEngineMode != ENGINE_ANALYZING))
+		{
+			NotHandled();
+			PromptForInput();
+			return;
+		}
+
+		szEval[0] = '\0';
+		if (sscanf(line, "%s %259s %15s", command, szFile, szEval) < 2)
+			printf("Usage: savehash <file> [eval]\n");
+		else if (!stricmp(szEval, "eval") && (nEngineMode != ENGINE_IDLE))
+			printf("The eval hash can only be saved when not analyzing\n");	// the helper threads write their eval hashes unverified
+		else if (SaveHashFile(szFile, !stricmp(szEval, "eval")))
+			printf("Saved hash to %s\n", szFile);
+		else
+			printf("Unable to save hash to %s\n", szFile);
+
+		PromptForInput();
+		return;
+	}
+
+	if (!strcmp(command, "loadhash"))	// load the hash tables, after setting up the position to analyze
+	{
+		char	szFile[MAX_PATH];
+
+		if (nEngineMode != ENGINE_IDLE)
+		{
+			NotHandled();
+			PromptForInput();
+			return;
+		}
+
+		if (sscanf(line, "%s %259s", command, szFile) < 2)
+			printf("Usage: loadhash <file>\n");
+		else if (LoadHashFile(szFile))
+			printf("Loaded hash from %s\n", szFile);
+		else
+			printf("Unable to load hash from %s -- it must exist and match the current hash size and network\n", szFile);
+
+		PromptForInput();
+		return;
+	}
+
+	if (!strcmp(command, "hashtest"))	// stress test the shared transposition table
+	{
+		int	nThreads = 8, nProbes = 10000000;
+		ULONGLONG starttime;
+
+        if (nEngineMode != ENGINE_IDLE)
+		{
+			NotHandled();
+			PromptForInput();
+			return;
+		}
+
+		sscanf(line, "%s %d %d", command, &nThreads, &nProbes);
+		nThreads = max(1, min(nThreads, MAX_CPUS));
+
+		starttime = GetTickCount64();
+		if (HashStressTest(nThreads, nProbes) == 0)
+			printf("passed");
+		else
+			printf("FAILED!");
+		printf(" in %.2f seconds\n", (float)((GetTickCount64() - starttime)) / 1000);
+
+		PromptForInput();
+		return;
+	}
+#endif
+
+	if (!strcmp(command, "sortbench"))	// time move selection
+	{
+		int	nIterations = 100000;
+
+        if (nEngineMode != ENGINE_IDLE)
+		{
+			NotHandled();
+			PromptForInput();
+			return;
+		}
+
+		sscanf(line, "%s %d", command, &nIterations);
+		SortBenchmark(max(1, nIterations));
+
+		PromptForInput();
+		return;
+	}
+
+	if (!strcmp(command, "accbench"))	// time make and unmake with the accumulator
+	{
+		int	nIterations = 100000;
+
+        if (nEngineMode != ENGINE_IDLE)
+		{
+			NotHandled();
+			PromptForInput();
+			return;
+		}
+
+		sscanf(line, "%s %d", command, &nIterations);
+		AccBenchmark(max(1, nIterations));
+
+		PromptForInput();
+		return;
+	}
+
+	if (!strcmp(command, "evalbench"))	// time the network and measure its sparsity
+	{
+		int	nIterations = 10000;
+
+        if (nEngineMode != ENGINE_IDLE)
+		{
+			NotHandled();
+			PromptForInput();
 			return;
+		}
+
+		sscanf(line, "%s %d", command, &nIterations);
+		EvalBenchmark(max(1, nIterations));
+
+		PromptForInput();
+		return;
+	}
+
+	if (!strcmp(command, "evalcheck"))	// compare the evals with the 8-bit and the 16-bit first layer weights
+	{
+        if (nEngineMode != ENGINE_IDLE)
+		{
+			NotHandled();
+			PromptForInput();
+			return;
+		}
+
+		EvalCheck();
+
+		PromptForInput();
+		return;
+	}
+
+#if !USE_CEREBRUM_1_0
+	if (!strcmp(command, "loadnet"))	// switch to another network between games
+	{
+		char	szFile[MAX_PATH] = NN_FILE;
+		int		nResult;
+
+        if (nEngineMode != ENGINE_IDLE)
+		{
+			NotHandled();
+			PromptForInput();
+			return;
+		}
+
+		// without a file, go back to the network the engine started with
+		if (sscanf(line, "%s %259s", command, szFile) < 2)
+#if defined(NN_EMBEDDED)
+			nResult = nn_load(NULL);
+#else
+			nResult = nn_load(szFile);
 #endif
+		else
+			nResult = nn_load(szFile);
+
+		if (nResult == -1)
+			printf("Unable to load network from %s -- keeping the current one\n", szFile);
+		else
+		{
+			// scores of the previous network must not come back from the hash tables
+#if USE_HASH
+			ClearHash();
+#endif
+			nn_update_all_pieces(bbBoard.Accumulator, bbBoard.bbPieces);
+		}
+
+		PromptForInput();
+		return;
+	}
+
+	if (!strcmp(command, "compactnet"))	// write the network with its first layer in 8 bits
+	{
+		char	szFile[MAX_PATH];
 
+        if (nEngineMode != ENGINE_IDLE)
+		{
+			NotHandled();
+			PromptForInput();
+			return;
+		}
+
+		if (sscanf(line, "%s %259s", command, szFile) < 2)
+			printf("Usage: compactnet <file>\n");
+		else if (nn_save_compact(szFile) == -1)
+			printf("Unable to write %s\n", szFile);
+
+		PromptForInput();
+		return;
+	}
+
+#if USE_SMALL_NET
+	if (!strcmp(command, "convertsmallnet"))	// build the small network file from "network small.txt" and use it
+	{
+		char	szFile[MAX_PATH] = NN_SMALL_FILE;
+
+        if (nEngineMode != ENGINE_IDLE)
+		{
+			NotHandled();
+			PromptForInput();
+			return;
+		}
+
+		if (nn_convert_small() == -1)
+			printf("Unable to convert \"network small.txt\"\n");
+		else if (nn_load_small(szFile) == -1)
+			printf("Unable to load small network from %s\n", szFile);
+		else
+			bSmallNet = TRUE;
+
+		PromptForInput();
+		return;
+	}
+
+	if (!strcmp(command, "smallnet"))	// load another small network, or stop using one, between games
+	{
+		char	szFile[MAX_PATH] = NN_SMALL_FILE;
+
+        if (nEngineMode != ENGINE_IDLE)
+		{
+			NotHandled();
+			PromptForInput();
+			return;
+		}
+
+		sscanf(line, "%s %259s", command, szFile);
+
+		if (!strcmp(szFile, "off"))
+		{
+			nn_load_small(NULL);
+			bSmallNet = FALSE;
+		}
+		else if (nn_load_small(szFile) == -1)
+			printf("Unable to load small network from %s -- keeping the current one\n", szFile);
+		else
+			bSmallNet = TRUE;
+
+		PromptForInput();
+		return;
+	}
+#endif
+
+	if (!strcmp(command, "evalbatch"))	// score a file of FENs with the network
+	{
+		char		szInFile[MAX_PATH], szOutFile[MAX_PATH];
+		int			nPositions, nSkipped;
+		ULONGLONG	starttime;
+
+        if (nEngineMode != ENGINE_IDLE)
+		{
+			NotHandled();
+			PromptForInput();
+			return;
+		}
+
+		if (sscanf(line, "%s %259s %259s", command, szInFile, szOutFile) < 3)
+			printf("Usage: evalbatch <infile> <outfile>\n");
+		else
+		{
+			starttime = GetTickCount64();
+			nPositions = EvalBatchFile(szInFile, szOutFile, &nSkipped);
+
+			if (nPositions < 0)
+				printf("Unable to read %s or write %s\n", szInFile, szOutFile);
+			else
+			{
+				ULONGLONG nTime = max(GetTickCount64() - starttime, 1);
+
+				printf("Scored %d positions (%d invalid lines skipped) on %d threads in %.2f seconds, %.0f positions per second\n",
+					nPositions, nSkipped, nCPUs, (float)nTime / 1000, (double)nPositions * 1000.0 / nTime);
+			}
+		}
+
+		PromptForInput();
+		return;
+	}
+#endif
+
+    if (!strcmp(command, "eval"))
+    {
         if (nEngineMode != ENGINE_IDLE)
 		{
 			NotHandled();
@@ -970,7 +1077,7 @@ void	HandleCommand(void)
 			nResult = GaviotaTBProbe(&bbBoard, FALSE);
         else
 #endif
-			nResult = BBEvaluate(&bbBoard, -MAX_WINDOW, MAX_WINDOW);
+			nResult = BBEvaluate(&bbBoard, -MAX_WINDOW, MAX_WINDOW, FALSE);
 
         printf("score = %d\n", nResult);
 
@@ -1021,10 +1128,6 @@ void	HandleCommand(void)
 #if USE_EGTB
 	if (!strcmp(command, "tb"))
 	{
-#if USE_SMP
-		if (!bSlave)
-			SendSlavesString(command);
-#endif
 
 		if (tb_available)
 		{
@@ -1047,10 +1150,7 @@ void	HandleCommand(void)
 
 	if (!strcmp(command, "quit"))
     {
-#if USE_SMP
-		if (!bSlave)
-			SendSlavesString(command);
-#endif
+        StopHelperThreads();
 #if USE_HASH
         CloseHash();
 #endif
@@ -1070,10 +1170,6 @@ void	HandleCommand(void)
     {
         if (nEngineMode == ENGINE_ANALYZING)
 		{
-#if USE_SMP
-			if (!bSlave)
-				SendSlavesString(command);
-#endif
 			nEngineMode = ENGINE_IDLE;
 			nEngineCommand = STOP_THINKING;
 			nCompSide = NO_SIDE;
@@ -1085,10 +1181,7 @@ void	HandleCommand(void)
 		}
 		else
 		{
-#if USE_SMP
-			if (!bSlave)
-				SendSlavesString((char *)"quit");
-#endif
+			StopHelperThreads();
 #if USE_HASH
 	        CloseHash();
 #endif
@@ -1106,11 +1199,6 @@ void	HandleCommand(void)
 
     if (!strcmp(command, "go"))
     {
-#if USE_SMP
-		if (bSlave)
-			return;
-#endif
-
         if (nEngineMode != ENGINE_IDLE)
 		{
 			NotHandled();
@@ -1125,27 +1213,8 @@ void	HandleCommand(void)
         return;
     }
 
-#if USE_SMP
-	if (!strcmp(command, "stop"))	// special command to tell slaves to stop thinking
-	{
-		if (bSlave && (nEngineMode == ENGINE_ANALYZING))
-		{
-			nEngineMode = ENGINE_IDLE;
-			nEngineCommand = STOP_THINKING;
-			nCompSide = NO_SIDE;
-		}
-
-		return;
-	}
-#endif
-
     if (!strcmp(command, "force"))
     {
-#if USE_SMP
-		if (!bSlave)
-			SendSlavesString((char *)"stop");
-#endif
-
         if (nEngineMode == ENGINE_ANALYZING)
 		{
 			NotHandled();
@@ -1172,10 +1241,6 @@ void	HandleCommand(void)
 
     if (!strcmp(command, "white"))
     {
-#if USE_SMP
-		if (bSlave)
-			return;
-#endif
         if (nEngineMode == ENGINE_ANALYZING)
 		{
 			NotHandled();
@@ -1197,10 +1262,6 @@ void	HandleCommand(void)
 
     if (!strcmp(command, "black"))
     {
-#if USE_SMP
-		if (bSlave)
-			return;
-#endif
         if (nEngineMode == ENGINE_ANALYZING)
 		{
 			NotHandled();
@@ -1222,10 +1283,6 @@ void	HandleCommand(void)
 
     if (!strcmp(command, "playother"))
     {
-#if USE_SMP
-		if (bSlave)
-			return;
-#endif
         if (nEngineMode == ENGINE_ANALYZING)
 		{
 			NotHandled();
@@ -1246,10 +1303,6 @@ void	HandleCommand(void)
 
     if (!strcmp(command, "?"))
     {
-#if USE_SMP
-		if (bSlave)
-			return;
-#endif
         if ((nEngineMode == ENGINE_ANALYZING) || (nEngineMode == ENGINE_PONDERING))
 		{
 			NotHandled();
@@ -1269,10 +1322,6 @@ void	HandleCommand(void)
 
     if (!strcmp(command, "st"))
     {
-#if USE_SMP
-		if (bSlave)
-			return;
-#endif
         sscanf(line, "st %d", &nThinkTime);
 		bExactThinkNodes = FALSE;
         bExactThinkTime = TRUE;
@@ -1287,10 +1336,6 @@ void	HandleCommand(void)
 
 	if (!strcmp(command, "nps"))
 	{
-#if USE_SMP
-		if (bSlave)
-			return;
-#endif
 		sscanf(line, "nps %d", &nThinkNodes);
 		nThinkNodes *= nThinkTime;
 		bExactThinkNodes = TRUE;
@@ -1306,10 +1351,6 @@ void	HandleCommand(void)
 
 	if (!strcmp(command, "sd"))
     {
-#if USE_SMP
-		if (bSlave)
-			return;
-#endif
         sscanf(line, "sd %d", &nThinkDepth);
 		bExactThinkNodes = FALSE;
 		bExactThinkDepth = TRUE;
@@ -1324,10 +1365,6 @@ void	HandleCommand(void)
 
     if (!strcmp(command, "level"))
     {
-#if USE_SMP
-		if (bSlave)
-			return;
-#endif
         char	szTime[16];
 
         // Myrddin doesn't have an internal clock, and gets all of its clock info from the "time" command. However,
@@ -1349,10 +1386,6 @@ void	HandleCommand(void)
 
     if (!strcmp(command, "time"))
     {
-#if USE_SMP
-		if (bSlave)
-			return;
-#endif
         int	nTime, nDivisor;
 
         // GetTickCount64() returns 1000's of a second, but Winboard uses 100's of a second
@@ -1408,10 +1441,6 @@ void	HandleCommand(void)
 
     if (!strcmp(command, "undo"))
     {
-#if USE_SMP
-		if (!bSlave)
-			SendSlavesString(command);
-#endif
         if (nGameMove == 0)
         {
             printf("No moves to undo!\n");
@@ -1446,10 +1475,6 @@ void	HandleCommand(void)
 
     if (!strcmp(command, "post"))
     {
-#if USE_SMP
-		if (bSlave)
-			return;
-#endif
         if (nEngineMode == ENGINE_ANALYZING)
         {
             NotHandled();
@@ -1468,10 +1493,6 @@ void	HandleCommand(void)
 
     if (!strcmp(command, "nopost"))
     {
-#if USE_SMP
-		if (bSlave)
-			return;
-#endif
         if (nEngineMode == ENGINE_ANALYZING)
         {
             NotHandled();
@@ -1490,10 +1511,6 @@ void	HandleCommand(void)
 
     if (!strcmp(command, "result"))
     {
-#if USE_SMP
-		if (bSlave)
-			return;
-#endif
         if (nEngineMode == ENGINE_ANALYZING)
         {
             NotHandled();
@@ -1519,12 +1536,12 @@ void	HandleCommand(void)
     {
         nEngineMode = ENGINE_ANALYZING;
         nThinkTime = 0xFFFFFFFF;
-		if (bSlave)
-			nCheckNodes = 0x3FFF;	// slaves need to check often for input, so every 32K nodes (about 50x per second)
-		else
-			nCheckNodes = 0x1FFFF;	// every 128K nodes, about 10x second, should be enough
+		nCheckNodes = 0x1FFFF;	// every 128K nodes, about 10x second, should be enough
 #if USE_HASH
-        ClearHash();
+        if (bHashLoaded)
+            bHashLoaded = FALSE;	// resume from the table read by "loadhash"
+        else
+            ClearHash();
 #endif
 
         if (bLog)
@@ -1544,10 +1561,6 @@ void	HandleCommand(void)
 
     if (!strcmp(command, "hard"))
     {
-#if USE_SMP
-		if (bSlave)
-			return;
-#endif
         bPondering = TRUE;
         PromptForInput();
 
@@ -1558,10 +1571,6 @@ void	HandleCommand(void)
 
     if (!strcmp(command, "easy"))
     {
-#if USE_SMP
-		if (bSlave)
-			return;
-#endif
         bPondering = FALSE;
         PromptForInput();
 
@@ -1572,10 +1581,6 @@ void	HandleCommand(void)
 
     if (!strcmp(command, "computer"))
     {
-#if USE_SMP
-		if (bSlave)
-			return;
-#endif
         bComputer = TRUE;
         PromptForInput();
 
@@ -1662,10 +1667,6 @@ void	HandleCommand(void)
 
 			if (!strnicmp(moveString, command, strlen(moveString)))	// we've found our move
             {
-#if USE_SMP
-				if (!bSlave)
-					SendSlavesString(moveString);
-#endif
 
                 // make the move on the board and update the official game movelist
                 BBMakeMove(&cmTempMoveList[n], &bbBoard, TRUE);
@@ -1771,19 +1772,11 @@ void PrintPV(int nPVEval, int nSideToMove, char comment, BOOL bPrintKibitz)
     int			n;
     char		moveString[24];
 	char		buf[1024]={0};
-	unsigned long long	nNodes = nSearchNodes;
+	unsigned long long	nNodes = GetSMPNodes();
 
     if ((nEngineMode == ENGINE_ANALYZING) && (nSideToMove == BLACK))
         nPVEval = -nPVEval;
 
-#if USE_SMP
-	if (!bSlave)
-	{
-		for (n = 0; n < nCPUs - 1; n++)
-			nNodes += smSharedMem->sdSlaveData[n].nSearchNodes;
-	}
-#endif
-
     sprintf(buf, "%2d %6d %6I64u %12llu ", nDepth, nPVEval, (GetTickCount64()-nThinkStart) / 10, nNodes);
 
     if (nEngineMode == ENGINE_PONDERING)
@@ -1834,10 +1827,10 @@ void PrintPV(int nPVEval, int nSideToMove, char comment, BOOL bPrintKibitz)
 	
 	strcat(buf, "\n");
 
-    if (bPost && !bSlave)
+    if (bPost)
         printf("%s", buf);
 
-    if (!bSlave && (bKibitz || bComputer) && bPrintKibitz)
+    if ((bKibitz || bComputer) && bPrintKibitz)
     {
         printf("tellics kibitz %s\n", buf);
         if (nPVEval >= CHECKMATE - 1024)
@@ -1854,70 +1847,6 @@ void PrintPV(int nPVEval, int nSideToMove, char comment, BOOL bPrintKibitz)
     fflush(stdout);
 }
 
-#if USE_SMP
-/*========================================================================
-** StartProcesses -- starts a number of slave processes for SMP support
-**========================================================================
-*/
-void StartProcesses(int nCPUs)
-{
-	if ((nCPUs > 1) && !bSlave)
-	{
-		int		n;
-		char	commandline[256];
-
-		// create slave processes
-		for (n = 0; n < nCPUs - 1; n++)
-		{
-			ZeroMemory(&si, sizeof(STARTUPINFO));
-			si.cb = sizeof(si);
-			ZeroMemory(&pi[n], sizeof(pi[n]));
-
-			sprintf(commandline, "\"%s\" slave sharedmem=%s sharedhash=%s numslave=%d", szProgName, szSharedMemName, szSharedHashName, n);
-#if DEBUG_SMP
-			printf("Launching slave process %d with '%s'\n", n, commandline);
-#endif
-
-			// Start the child process. 
-			if( !CreateProcess( NULL,   // No module name (use command line)
-				commandline,        // Command line
-				NULL,           // Process handle not inheritable
-				NULL,           // Thread handle not inheritable
-				FALSE,          // Set handle inheritance to FALSE
-#if DEBUG_SMP
-				CREATE_NO_WINDOW, // CREATE_NEW_CONSOLE,
-#else
-				CREATE_NO_WINDOW,              // No creation flags
-#endif
-				NULL,           // Use parent's environment block
-				NULL,           // Use parent's starting directory 
-				&si,            // Pointer to STARTUPINFO structure
-				&pi[n] )        // Pointer to PROCESS_INFORMATION structure
-			) 
-			{
-				printf( "CreateProcess failed (%d).\n", (int)GetLastError() );
-			}
-		}
-	}
-}
-
-/*========================================================================
-** KillProcesses -- kill all SMP processes on shutdown
-**========================================================================
-*/
-void KillProcesses(void)
-{
-	// this is just in case the program was terminated via the dos box
-	int n;
-
-	for (n = 0; n < nCPUs - 1; n++)
-	{
-        TerminateProcess(pi[n].hProcess, 0); // Don't use force, just get a bigger hammer.
-		CloseHandle(pi[n].hThread);
-	}
-}
-#endif
-
 void cleanup(void)
 {
 	if (bLog)
@@ -1932,26 +1861,12 @@ void cleanup(void)
 ** to search
 **========================================================================
 */
-#if USE_SMP
-int main(int argc, char *argv[])
-#else
 int main(void)
-#endif
 {
-#if USE_SMP
-	atexit(KillProcesses);	// just in case the program was shut down via the dos box, this will cover all exit cases
-#endif
+	atexit(StopHelperThreads);	// just in case the program was shut down via the dos box, this will cover all exit cases
 
     bLog = bKibitz = FALSE;
 
-#if USE_SMP
-	strcpy(szProgName, argv[0]);
-	ParseCommandline(argc, argv);
-#if DEBUG_SMP
-	if (bSlave)
-		printf("This is slave number %d\n", nSlaveNum);
-#endif
-#endif
     ParseIniFile();
 	
 	_timeb  tb;
@@ -1966,7 +1881,7 @@ int main(void)
         char	fn[128];
 
         _mkdir("logs");
-		sprintf(fn, "logs\\Myrddin-%lld-%d-%s%d.log", (long long) tb.time, tb.millitm, (bSlave ? "slave" : ""), nSlaveNum+1);
+		sprintf(fn, "logs\\Myrddin-%lld-%d.log", (long long) tb.time, tb.millitm);
         logfile = fopen(fn, "w+");
 
         if (!logfile)
@@ -1991,16 +1906,13 @@ int main(void)
 
     fflush(stdin);
 
-	if (!bSlave)
-	{
-		printf("\n");
-		printf("#-------------------------------#\n");
-		printf("# %-13s - %-13s #\n", szVersion, szInfo);
-		printf("# Copyright 2025 - John Merlino #\n");
-		printf("# All Rights Reserved           #\n");
-		printf("#-------------------------------#\n\n");
-		printf("feature done=0\n");	// just in case -- this shouldn't be harmful according to Tim Mann
-	}
+	printf("\n");
+	printf("#-------------------------------#\n");
+	printf("# %-13s - %-13s #\n", szVersion, szInfo);
+	printf("# Copyright 2025 - John Merlino #\n");
+	printf("# All Rights Reserved           #\n");
+	printf("#-------------------------------#\n\n");
+	printf("feature done=0\n");	// just in case -- this shouldn't be harmful according to Tim Mann
 
 #if USE_HASH
     if (InitHash() == NULL)
@@ -2012,27 +1924,29 @@ int main(void)
     }
 #endif
 
-#if USE_SMP
-	StartProcesses(nCPUs);
-#if DEBUG_SMP
-	printf("Launching %d process%s\n", nCPUs, (nCPUs > 1 ? "es" : ""));
-#endif
-#endif
-
     initbitboards();
     InitThink();
 
-	char nnFileName[32] = NN_FILE;
 //	nn_convert();
+#if defined(NN_EMBEDDED)
+	if (nn_load(NULL) == -1)
+#else
+	char nnFileName[32] = NN_FILE;
 	if (nn_load(nnFileName) == -1)
+#endif
 	{
 		printf("Unable to load network data. Cannot continue\n");
 		return(0);
 	}
 
+#if USE_SMALL_NET
+	// the small network is optional
+	char nnSmallFileName[32] = NN_SMALL_FILE;
+	bSmallNet = (nn_load_small(nnSmallFileName) == 0);
+#endif
+
 #if USE_OPENING_BOOK
-	if (!bSlave)
-	    INITIALIZE();	// prodeo book
+    INITIALIZE();	// prodeo book
 #endif
 
 #if USE_EGTB
@@ -2049,37 +1963,16 @@ int main(void)
     bExactThinkTime = FALSE;
     bExactThinkDepth = FALSE;
 
-	if (!bSlave)
-	{
-		InitializeInput();
-		if (bXboard)
-			printf("done=1\n");
-
-#if USE_SMP
-		int	x;
-
-		// clear out slave communication data and set it to locked to wait for slaves to be ready
-		for (x = 0; x < nCPUs - 1; x++)
-		{
-			ZeroMemory(&smSharedMem->sdSlaveData[x], sizeof(SLAVE_DATA));
-			smSharedMem->sdSlaveData[x].bLocked = TRUE;
-		}
-#endif
-	}
-#if USE_SMP
-	else
-		smSharedMem->sdSlaveData[nSlaveNum].bLocked = FALSE;
-#endif
+	InitializeInput();
+	if (bXboard)
+		printf("done=1\n");
 
     PromptForInput();
 
     // main engine/input loop
     for (;;)
     {
-		if (!bSlave)
-			fflush(stdout);
-		else
-			nCompSide = NO_SIDE;
+		fflush(stdout);
 
         if (nEngineMode == ENGINE_ANALYZING)
             nCompSide = bbBoard.sidetomove;	// when analyzing, assume the engine is always on the move
@@ -2095,7 +1988,7 @@ int main(void)
             *FROM = '\0';
 
             // book depth is max 60 plies
-            if ((nEngineMode != ENGINE_ANALYZING) && (nEngineCommand != PONDER) && (nGameMove < 60) && (!bSlave))
+            if ((nEngineMode != ENGINE_ANALYZING) && (nEngineCommand != PONDER) && (nGameMove < 60))
             {
                 BBBoardToForsythe(&bbBoard, 0, EPD);
                 FIND_OPENING();
@@ -2133,13 +2026,6 @@ int main(void)
 
                         MoveToString(moveString, &cmChosenMove, TRUE);
                         printf("\n%s\n", moveString);
-#if USE_SMP
-						if (!bSlave)
-						{
-							MoveToString(moveString, &cmChosenMove, FALSE);
-							SendSlavesString(moveString);
-						}
-#endif
                         fflush(stdout);
 
                         if (bKibitz || bComputer)
@@ -2171,9 +2057,6 @@ int main(void)
 #if SHOW_QS_NODES
                 nQNodes = 0;
 #endif
-#if USE_SMP
-				ZeroSlaveNodes();
-#endif
 
                 if (nEngineMode != ENGINE_ANALYZING)
                 {
@@ -2196,25 +2079,12 @@ int main(void)
 
                 BBGenerateAllMoves(&bbBoard, cmTempMoveList, &nNumMoves, FALSE);
 
-#if USE_SMP
-				if (!bSlave)
-					SendSlavesString((char *)"analyze");
-#endif
+				StartHelperThreads();
 
                 // iterative depth loop
                 do
                 {
-#if 1 // USE_SMP
-                    if (bSlave)
-                    {
-                        if ((nSlaveNum+1) & 1)
-                            nEval = Think(nDepth + 1);
-                        else
-                            nEval = Think(nDepth);
-                    }
-                    else
-#endif
-					    nEval = Think(nDepth);
+				    nEval = Think(nDepth);
 
                     // we've been told to jump out of the loop, either due to a command or time concerns
                     if ((nEngineCommand == STOP_THINKING) || (nEngineCommand == END_THINKING))
@@ -2285,14 +2155,6 @@ int main(void)
 
                     nDepth++;
 
-#if 0 // USE_SMP         // more aggressive depth adjustment for some child processes
-                    if (bSlave)
-                    {
-                        if ((nSlaveNum & 1) == 0)
-                            nDepth++;
-                    }
-#endif
-
                     if (((nEngineMode == ENGINE_PONDERING) || (nEngineMode == ENGINE_ANALYZING)) && (nDepth > MAX_DEPTH))
                     {
                         // we've reached our maximum depth. If we're on the move, we'll just make a move here. But if not,
@@ -2315,6 +2177,8 @@ int main(void)
                 }
                 while (nDepth <= MAX_DEPTH);
 
+				StopHelperThreads();
+
                 // we have a move, so play it and update the game board/movelist
                 if ((evalPV.pvLength || (nEngineCommand == END_THINKING)) && (nEngineMode == ENGINE_THINKING) &&
                         (nEngineCommand != STOP_THINKING))
@@ -2331,16 +2195,6 @@ int main(void)
                     MoveToString(moveString, &cmChosenMove, TRUE);
 
                     printf("\n%s\n", moveString);
-#if USE_SMP
-					if (!bSlave)
-					{
-						if (!bPondering)
-							SendSlavesString((char *)"stop");
-
-						MoveToString(moveString, &cmChosenMove, FALSE);
-						SendSlavesString(moveString);
-					}
-#endif
                     fflush(stdout);
 
                     BBMakeMove(&cmChosenMove, &bbBoard, TRUE);
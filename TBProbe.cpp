@@ -25,15 +25,17 @@ int tb_available = FALSE;			/* 0 => FALSE, 1 => TRUE */
 #if USE_EGTB
 
 char **paths;	/* paths where TB files will be searched */
-int	stm;				/* side to move */
-int	epsquare;			/* target square for an en passant capture */
-int	castling;			/* castling availability, 0 => no castles */
-unsigned int  ws[17];	/* list of squares for white */
-unsigned int  bs[17];	/* list of squares for black */
-unsigned char wp[17];	/* what white pieces are on those squares */
-unsigned char bp[17];	/* what black pieces are on those squares */
-unsigned info = tb_UNKNOWN;	/* default, no tbvalue */
-unsigned pliestomate;
+
+// probe state is per search thread
+thread_local int	stm;				/* side to move */
+thread_local int	epsquare;			/* target square for an en passant capture */
+thread_local int	castling;			/* castling availability, 0 => no castles */
+thread_local unsigned int  ws[17];	/* list of squares for white */
+thread_local unsigned int  bs[17];	/* list of squares for black */
+thread_local unsigned char wp[17];	/* what white pieces are on those squares */
+thread_local unsigned char bp[17];	/* what black pieces are on those squares */
+thread_local unsigned info = tb_UNKNOWN;	/* default, no tbvalue */
+thread_local unsigned pliestomate;
 
 /*========================================================================
 ** GavtiotaTBProbe - Probes the Gaviota TBs if less than five pieces
@@ -303,4 +305,4 @@ void GaviotaTBClose(void)
     paths = (char **) tbpaths_done((const char **)paths);
 }
 
-#endif	// USE_EGTB
\ No newline at end of file
+#endif	// USE_EGTB
\ No newline at end of file
@@ -34,18 +34,30 @@ enum thinking_modes
 
 typedef struct 
 {
-    CHESSMOVE	cmKiller;
+    PACKEDMOVE	pmKiller;
     long		nEval;
 } KILLER, *PKILLER;
 
-extern unsigned long long nSearchNodes, nQNodes, nPerftMoves;
-extern PV  evalPV, prevDepthPV;
-extern int nCurEval, nPrevEval;
-extern BB_BOARD bbEvalBoard;
+// search state is per thread for Lazy SMP
+extern thread_local unsigned long long nSearchNodes, nQNodes;
+extern thread_local PV  evalPV, prevDepthPV;
+extern thread_local int nCurEval, nPrevEval;
+extern thread_local BB_BOARD bbEvalBoard;
+extern thread_local int nThreadNum;
+
+extern unsigned long long nPerftMoves;
 
 unsigned long long doBBPerft(int depth, BB_BOARD *Board, BOOL bDivide);
 int		Think(int nDepth);
 void	ClearHistory(void);
 void	ClearKillers(BOOL bScoreOnly);
 void    InitThink(void);
+void	SortBenchmark(int nIterations);
+void	AccBenchmark(int nIterations);
+void	EvalBenchmark(int nIterations);
+void	EvalCheck(void);
 int     BBSEEMove(CHESSMOVE* cmMove, int ctSide);
+
+void	StartHelperThreads(void);
+void	StopHelperThreads(void);
+unsigned long long GetSMPNodes(void);
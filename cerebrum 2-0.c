@@ -73,6 +73,17 @@
 
 #include "cerebrum 2-0.h"
 
+#if defined(NN_WITH_MMAP)
+	#if defined(_WIN32)
+		#include <windows.h>
+	#else
+		#include <fcntl.h>
+		#include <unistd.h>
+		#include <sys/mman.h>
+		#include <sys/stat.h>
+	#endif
+#endif
+
 #define NN_GET_POSITION(pieces) __builtin_ctzll(pieces)
 #define NN_POP_POSITION(pieces) pieces &= pieces - 1
 
@@ -89,7 +100,27 @@
 	#define NN_LAST_LAYER L4
 #endif
 
-#define NN_WITH_AVX
+// x86-64 : the scalar, SSE4.1, AVX2 and AVX-512 kernels are all built, and
+// the fastest ones that the CPU supports are picked at run time
+#if defined(__x86_64__) || defined(_M_X64)
+#define NN_WITH_X86
+#endif
+
+// 64-bit ARM : NEON is always there, the scalar kernels are only kept to
+// compare with
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define NN_WITH_ARM
+#endif
+
+// kernels that need the blocked copies of the weights built by nn_load()
+#if defined(NN_WITH_X86) || defined(NN_WITH_ARM)
+#define NN_WITH_SIMD
+#endif
+
+// __cpuid() and _xgetbv()
+#if defined(NN_WITH_X86) && defined(_MSC_VER)
+	#include <intrin.h>
+#endif
 
 
 /****************************************************************************/
@@ -117,10 +148,141 @@ typedef struct {
 	#endif
 } NN_Network;
 
+// the same network with W0 in 8 bits, as written by nn_save_compact() : the
+// weights are W0 >> W0_shift, rounded (W0_shift is 0 when they all fit)
+typedef struct {
+	char name[256];
+	char author[256];
+	
+	int8_t W0_shift;
+	int8_t reserved[63]; // so that W0 starts on a cache line too
+	
+	int8_t W0[NN_SIZE_L0 * NN_SIZE_L1];
+	int16_t B0[NN_SIZE_L1];
+	
+	int8_t W1[NN_SIZE_L1 * 2 * NN_SIZE_L2];
+	int8_t B1[NN_SIZE_L2];
+	
+	#if NN_SIZE_L3 != None
+	int8_t W2[NN_SIZE_L2 * NN_SIZE_L3];
+	int8_t B2[NN_SIZE_L3];
+	#endif
+	
+	#if NN_SIZE_L4 != None
+	int8_t W3[NN_SIZE_L3 * NN_SIZE_L4];
+	int8_t B3[NN_SIZE_L4];
+	#endif
+} NN_CompactNetwork;
+
+// the small network : layer 1 (the accumulator of the big one, clamped)
+// straight to the output, for when speed matters more than accuracy
+typedef struct {
+	char name[256];
+	char author[256];
+	
+	int8_t W1[NN_SIZE_L1 * 2];
+	int8_t B1[1];
+} NN_SmallNetwork;
+
 static const int8_t FACTOR = 64;
 
-static NN_Network network;
-static NN_Network* nn = &network;
+alignas(64) static NN_Network network; // so that every W0 row starts on a cache line
+static const NN_Network* nn = &network;  // network, the mapped file or the embedded one
+
+// W0 as the kernels read it, times 1 << nn_w0_shift, and the 16-bit one
+// (NULL when the network was read from an 8-bit file)
+#if defined(NN_WITH_INT8_W0)
+typedef int8_t nn_w0_t;
+
+alignas(64) static int8_t W0_narrow[NN_SIZE_L0 * NN_SIZE_L1]; // W0 of a 16-bit file, narrowed by nn_load()
+static const nn_w0_t* nn_w0 = W0_narrow;
+#else
+typedef int16_t nn_w0_t;
+
+static const nn_w0_t* nn_w0 = network.W0;
+#endif
+
+static int nn_w0_shift = 0;
+static const int16_t* nn_w0_16 = network.W0;
+
+static uint32_t nn_hash = 0; // nn_checksum() of the current network, computed by nn_load()
+
+static NN_SmallNetwork small_network;
+static const NN_SmallNetwork* nn_small = NULL; // NULL until one is loaded
+
+#if defined(NN_WITH_MMAP)
+// the current mapping of a network file, if any
+static const void* nn_view = NULL;
+static size_t nn_view_size = 0;
+#endif
+
+#if defined(NN_EMBEDDED)
+// the network file, built into the executable by the assembler and aligned
+// like the static copy (symbols of 32-bit Windows and macOS start with '_')
+#if defined(_WIN32)
+	#define NN_RODATA ".section .rdata,\"dr\"\n"
+#else
+	#define NN_RODATA ".section .rodata\n"
+#endif
+
+#if defined(__APPLE__) || (defined(_WIN32) && !defined(_WIN64))
+	#define NN_SYMBOL(name) "_" #name
+#else
+	#define NN_SYMBOL(name) #name
+#endif
+
+__asm__(
+	NN_RODATA
+	".balign 64\n"
+	".globl " NN_SYMBOL(nn_embedded_data) "\n"
+	NN_SYMBOL(nn_embedded_data) ":\n"
+	".incbin \"" NN_FILE "\"\n"
+	".globl " NN_SYMBOL(nn_embedded_end) "\n"
+	NN_SYMBOL(nn_embedded_end) ":\n"
+	".text\n"
+);
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+extern const unsigned char nn_embedded_data[];
+extern const unsigned char nn_embedded_end[];
+#if defined(__cplusplus)
+}
+#endif
+#endif
+
+#if defined(NN_WITH_SIMD)
+// W1 in input-major order, built by nn_load() : for each block of 4 inputs,
+// the 4 weights of output 0, then the 4 weights of output 1, and so on
+alignas(64) static int8_t W1_sparse[NN_SIZE_L1 * 2 * NN_SIZE_L2];
+alignas(64) static int32_t B1_scaled[NN_SIZE_L2]; // B1 * FACTOR
+#endif
+
+#if defined(NN_WITH_SIMD) && (NN_SIZE_L3 != None) && (NN_SIZE_L4 == 1)
+// W2 in input-major order too, and B2 * FACTOR, built by nn_load()
+alignas(64) static int8_t W2_blocked[NN_SIZE_L2 * NN_SIZE_L3];
+alignas(64) static int32_t B2_scaled[NN_SIZE_L3];
+#endif
+
+// instruction sets that a set of kernels needs
+#define NN_CPU_SSE41  1
+#define NN_CPU_AVX2   2
+#define NN_CPU_AVX512 4 // with BW, VL and VNNI
+
+// the public functions that depend on the instruction set, for one of them
+typedef struct {
+	const char* name;
+	int cpu;
+	
+	void (*add_piece)(NN_Accumulator accumulator, int piece_type, int piece_color, int piece_position);
+	void (*del_piece)(NN_Accumulator accumulator, int piece_type, int piece_color, int piece_position);
+	void (*mov_piece)(NN_Accumulator accumulator, int piece_type, int piece_color, int from, int to);
+	void (*update_accumulator)(NN_Accumulator output, NN_Accumulator input, const NN_Change* del, int del_count, const NN_Change* add, int add_count);
+	int (*evaluate)(NN_Accumulator accumulator, int color);
+	void (*evaluate_batch)(NN_Accumulator* accumulators, const int* colors, int* evals, int count);
+	int (*evaluate_small)(NN_Accumulator accumulator, int color);
+} NN_Kernels;
 
 
 /****************************************************************************/
@@ -153,57 +315,202 @@ static int8_t nn_clamp_lay(int32_t sum) {
 	return (int8_t) (sum);
 }
 
-/* I = Input layer, W = Weights, B = Biases, O = Output layer       */
-/* idim/odim = size of input/output layers (i.e. number of neurons) */
+/* output of the last layer to centipawns, from the side to move's point */
+/* of view                                                              */
 
-static void nn_compute_layer(int8_t* I, int8_t* W, int8_t* B, int8_t* O8, int32_t* O32, int idim, int odim) {
-	#if defined(NN_WITH_AVX)
-		const __m256i one = _mm256_set1_epi16(1);
+static int nn_centipawns(int32_t output) {
+	const float eval = ((float) output) / ((float) FACTOR);
+	
+	return (int) (100.0f * eval);
+}
+
+/* W0 in 8 bits : the smallest shift that makes every weight fit, then  */
+/* each weight shifted right with rounding (exact when the shift is 0)  */
+
+static int nn_narrow_w0(const int16_t* W0, int8_t* narrow) {
+	int shift = 0;
+	
+	for (int i = 0; i < NN_SIZE_L0 * NN_SIZE_L1; i++) {
+		while ((W0[i] >> shift) > 127 || (W0[i] >> shift) < -128) {
+			shift++;
+		}
+	}
+	
+	for (int i = 0; i < NN_SIZE_L0 * NN_SIZE_L1; i++) {
+		int value = (shift == 0) ? W0[i] : ((W0[i] + (1 << (shift - 1))) >> shift);
 		
-		for (int o = 0; o < odim; o++) {
-			__m256i sum = _mm256_setzero_si256();
-			
-			for (int i = 0; i < idim; i += 32) {
-				const __m256i inp = _mm256_loadu_si256((__m256i_u*) &I[i]);
-				const __m256i wei = _mm256_loadu_si256((__m256i_u*) &W[o * idim + i]);
-				const __m256i dot = _mm256_madd_epi16(_mm256_maddubs_epi16(inp, wei), one);
-				
-				sum = _mm256_add_epi32(sum, dot);
-			}
-			
-			const __m128i sum128lo = _mm256_castsi256_si128(sum);
-			const __m128i sum128hi = _mm256_extracti128_si256(sum, 1);
-			
-			__m128i sum128 = _mm_add_epi32(sum128lo, sum128hi);
-			
-			sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, _MM_PERM_ABCD));
-			sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, _MM_PERM_CDAB));
-			
-			if (O8 != NULL) {
-				O8[o] = nn_clamp_lay(_mm_cvtsi128_si32(sum128) + B[o] * FACTOR);
-			} else {
-				O32[o] = (_mm_cvtsi128_si32(sum128) + B[o] * FACTOR) / FACTOR;
-			}
+		narrow[i] = (int8_t) ((value > 127) ? 127 : value);
+	}
+	
+	return shift;
+}
+
+#if defined(NN_WITH_X86)
+
+/* instruction sets that both the CPU and the OS support (the OS has to */
+/* save the wider registers on context switches)                       */
+
+static int nn_cpu_features(void) {
+	int features = 0;
+	
+	#if defined(_MSC_VER)
+		int regs[4];
+		
+		__cpuid(regs, 0);
+		const int max_leaf = regs[0];
+		
+		__cpuid(regs, 1);
+		const int sse41 = (regs[2] >> 19) & 1;
+		const int osxsave = (regs[2] >> 27) & 1;
+		const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+		
+		int ebx7 = 0, ecx7 = 0;
+		
+		if (max_leaf >= 7) {
+			__cpuidex(regs, 7, 0);
+			ebx7 = regs[1];
+			ecx7 = regs[2];
+		}
+		
+		if (sse41) {
+			features |= NN_CPU_SSE41;
+		}
+		
+		// XMM and YMM state, then opmask and ZMM state too
+		if (((xcr0 & 0x06) == 0x06) && (ebx7 & (1 << 5))) {
+			features |= NN_CPU_AVX2;
+		}
+		
+		if (((xcr0 & 0xE6) == 0xE6) && (ebx7 & (1 << 16)) && (ebx7 & (1 << 30)) && (ebx7 & (1 << 31)) && (ecx7 & (1 << 11))) {
+			features |= NN_CPU_AVX512;
 		}
 	#else
-		for (int o = 0; o < odim; o++) {
-			int32_t sum = B[o] * FACTOR;
-			
-			// naive dot product
-			
-			for (int i = 0; i < idim; i++) {
-				sum += I[i] * W[o * idim + i];
-			}
-			
-			if (O8 != NULL) {
-				O8[o] = nn_clamp_lay(sum);
-			} else {
-				O32[o] = sum / FACTOR;
-			}
+		__builtin_cpu_init();
+		
+		if (__builtin_cpu_supports("sse4.1")) {
+			features |= NN_CPU_SSE41;
+		}
+		
+		if (__builtin_cpu_supports("avx2")) {
+			features |= NN_CPU_AVX2;
+		}
+		
+		if (__builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx512vnni")) {
+			features |= NN_CPU_AVX512;
 		}
 	#endif
+	
+	return features;
 }
 
+#endif
+
+
+/****************************************************************************/
+/** KERNELS                                                                **/
+/****************************************************************************/
+
+// one copy of "cerebrum 2-0.inc" per instruction set, the compiler being
+// told to target it for that copy only (MSVC needs no such option)
+
+#define NN_KERNEL(name) name##_scalar
+#define NN_KERNEL_NAME "scalar"
+#define NN_KERNEL_CPU 0
+	#include "cerebrum 2-0.inc"
+#undef NN_KERNEL
+#undef NN_KERNEL_NAME
+#undef NN_KERNEL_CPU
+
+#if defined(NN_WITH_X86)
+
+#if defined(__clang__)
+	#pragma clang attribute push (__attribute__((target("sse4.1"))), apply_to = function)
+#elif defined(__GNUC__)
+	#pragma GCC push_options
+	#pragma GCC target("sse4.1")
+#endif
+
+#define NN_WITH_SSE
+#define NN_KERNEL(name) name##_sse41
+#define NN_KERNEL_NAME "sse41"
+#define NN_KERNEL_CPU NN_CPU_SSE41
+	#include "cerebrum 2-0.inc"
+#undef NN_KERNEL
+#undef NN_KERNEL_NAME
+#undef NN_KERNEL_CPU
+#undef NN_WITH_SSE
+
+#if defined(__clang__)
+	#pragma clang attribute pop
+	#pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+	#pragma GCC target("avx2")
+#endif
+
+#define NN_WITH_AVX
+#define NN_KERNEL(name) name##_avx2
+#define NN_KERNEL_NAME "avx2"
+#define NN_KERNEL_CPU (NN_CPU_SSE41 | NN_CPU_AVX2)
+	#include "cerebrum 2-0.inc"
+#undef NN_KERNEL
+#undef NN_KERNEL_NAME
+#undef NN_KERNEL_CPU
+
+#if defined(__clang__)
+	#pragma clang attribute pop
+	#pragma clang attribute push (__attribute__((target("avx2,avx512f,avx512bw,avx512vl,avx512vnni"))), apply_to = function)
+#elif defined(__GNUC__)
+	#pragma GCC target("avx2,avx512f,avx512bw,avx512vl,avx512vnni")
+#endif
+
+#define NN_WITH_AVX512
+#define NN_KERNEL(name) name##_avx512
+#define NN_KERNEL_NAME "avx512"
+#define NN_KERNEL_CPU (NN_CPU_SSE41 | NN_CPU_AVX2 | NN_CPU_AVX512)
+	#include "cerebrum 2-0.inc"
+#undef NN_KERNEL
+#undef NN_KERNEL_NAME
+#undef NN_KERNEL_CPU
+#undef NN_WITH_AVX512
+#undef NN_WITH_AVX
+
+#if defined(__clang__)
+	#pragma clang attribute pop
+#elif defined(__GNUC__)
+	#pragma GCC pop_options
+#endif
+
+#endif
+
+#if defined(NN_WITH_ARM)
+
+#define NN_WITH_NEON
+#define NN_KERNEL(name) name##_neon
+#define NN_KERNEL_NAME "neon"
+#define NN_KERNEL_CPU 0
+	#include "cerebrum 2-0.inc"
+#undef NN_KERNEL
+#undef NN_KERNEL_NAME
+#undef NN_KERNEL_CPU
+#undef NN_WITH_NEON
+
+#endif
+
+// fastest first
+static const NN_Kernels* const nn_kernels_all[] = {
+	#if defined(NN_WITH_X86)
+	&nn_kernels_avx512,
+	&nn_kernels_avx2,
+	&nn_kernels_sse41,
+	#endif
+	#if defined(NN_WITH_ARM)
+	&nn_kernels_neon,
+	#endif
+	&nn_kernels_scalar
+};
+
+static const NN_Kernels* nn_kernels = &nn_kernels_scalar;
+static int nn_kernels_selected = 0;
 
 /****************************************************************************/
 /** PUBLIC FUNCTIONS                                                       **/
@@ -405,215 +712,538 @@ int nn_convert(void) {
 	return 0;
 }
 
-int nn_load(char* filename) {
-	*nn = (NN_Network) {0};
+/* builds the small network file (NN_SMALL_FILE) from 'network small.txt' : */
+/* the name, author and parameters lines of 'network.txt', then the       */
+/* NN_SIZE_L1 * 2 weights of W1 (one row, in the order of a row of the big */
+/* network's W1) and the B1 bias, one value per line                      */
+
+int nn_convert_small(void) {
+	printf("info debug NN small file : conversion...\n");
 	
-	FILE* file = fopen(filename, "rb");
+	NN_SmallNetwork* st = (NN_SmallNetwork*) calloc(1, sizeof(NN_SmallNetwork));
+	
+	if (st == NULL) {
+		printf("info debug NN small file : ERROR while allocating memory\n");
+		return -1;
+	}
+	
+	FILE* file = fopen("network small.txt", "r");
 	
 	if (file == NULL) {
+		printf("info debug NN small file : ERROR while opening 'network small.txt'\n");
+		free(st);
+		return -1;
+	}
+	
+	char line[256];
+	int32_t loaded = 0;
+	int32_t expected = 0;
+	int8_t value = 0;
+	
+	if (fgets(line, 256, file) == NULL || sscanf(line, "name=%255[^\n]", st->name) != 1
+	||  fgets(line, 256, file) == NULL || sscanf(line, "author=%255[^\n]", st->author) != 1
+	||  fgets(line, 256, file) == NULL || sscanf(line, "parameters=%d", &expected) != 1) {
+		printf("info debug NN small file : ERROR while parsing the header\n");
+		fclose(file);
+		free(st);
 		return -1;
 	}
 	
-	size_t read = fread(nn, sizeof(NN_Network), 1, file);
+	// W1
+	for (int col = 0; col < (NN_SIZE_L1 * 2); col++) {
+		if (fgets(line, 256, file) == NULL || sscanf(line, "%hhd", &value) != 1) {
+			printf("info debug NN small file : ERROR while parsing 'W1'\n");
+			fclose(file);
+			free(st);
+			return -1;
+		}
+		st->W1[col] = value;
+		loaded++;
+	}
+	
+	// B1
+	if (fgets(line, 256, file) == NULL || sscanf(line, "%hhd", &value) != 1) {
+		printf("info debug NN small file : ERROR while parsing 'B1'\n");
+		fclose(file);
+		free(st);
+		return -1;
+	}
+	st->B1[0] = value;
+	loaded++;
 	
 	fclose(file);
 	
-	if (read == 0) {
+	printf("info debug NN small file : %i loaded parameters\n", loaded);
+	printf("info debug NN small file : %i expected parameters\n", expected);
+	
+	if (loaded != expected) {
+		printf("info debug NN small file : ERROR 'loaded' and 'expected' values differ\n");
+		free(st);
 		return -1;
 	}
 	
-	printf("info debug NN infos : %s by %s\n", nn->name, nn->author);
+	file = fopen(NN_SMALL_FILE, "wb");
 	
-	return 0;
+	if (file == NULL) {
+		printf("info debug NN small file : ERROR while saving network\n");
+		free(st);
+		return -1;
+	}
+	
+	size_t written = fwrite(st, sizeof(NN_SmallNetwork), 1, file);
+	
+	fclose(file);
+	free(st);
+	
+	return (written == 1) ? 0 : -1;
 }
 
-void nn_init_accumulator(NN_Accumulator accumulator) {
-	#if defined(NN_WITH_AVX)
-		memcpy(&(accumulator[0]), &(nn->B0[0]), NN_SIZE_L1 * sizeof(int16_t));
-		memcpy(&(accumulator[1]), &(nn->B0[0]), NN_SIZE_L1 * sizeof(int16_t));
+#if defined(NN_WITH_MMAP)
+
+/* maps a network file read-only, so that every process shares the same  */
+/* physical copy of it ; the view is page aligned, and so is W0 (64-byte) */
+
+static const void* nn_map_file(const char* filename, size_t* size) {
+	#if defined(_WIN32)
+		HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		
+		if (file == INVALID_HANDLE_VALUE) {
+			return NULL;
+		}
+		
+		LARGE_INTEGER length;
+		
+		if (!GetFileSizeEx(file, &length) || length.QuadPart < (LONGLONG) sizeof(NN_CompactNetwork)) {
+			CloseHandle(file);
+			return NULL;
+		}
+		
+		HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		
+		CloseHandle(file);
+		
+		if (mapping == NULL) {
+			return NULL;
+		}
+		
+		const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		
+		CloseHandle(mapping); // the view keeps the mapping alive
+		
+		*size = (size_t) length.QuadPart;
+		
+		return view;
 	#else
-		for (int o = 0; o < NN_SIZE_L1; o++) {
-			accumulator[0][o] = nn->B0[o];
-			accumulator[1][o] = nn->B0[o];
+		int file = open(filename, O_RDONLY);
+		
+		if (file == -1) {
+			return NULL;
 		}
+		
+		struct stat st;
+		
+		if (fstat(file, &st) == -1 || st.st_size < (off_t) sizeof(NN_CompactNetwork)) {
+			close(file);
+			return NULL;
+		}
+		
+		void* view = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, file, 0);
+		
+		close(file);
+		
+		if (view == MAP_FAILED) {
+			return NULL;
+		}
+		
+		*size = (size_t) st.st_size;
+		
+		return view;
 	#endif
 }
 
-void nn_add_piece(NN_Accumulator accumulator, int piece_type, int piece_color, int piece_position) {
-	#if defined(NN_DEBUG)
-		assert(piece_type >= 0 && piece_type < 6);
-		assert(piece_color >= 0 && piece_color < 2);
-		assert(piece_position >= 0 && piece_position < 64);
+static void nn_unmap_file(const void* view, size_t size) {
+	#if defined(_WIN32)
+		(void) size;
+		UnmapViewOfFile(view);
+	#else
+		munmap((void*) view, size);
+	#endif
+}
+
+#endif
+
+/* NULL picks the fastest kernels that the CPU supports ; otherwise, the  */
+/* ones of that name ("scalar", "sse41", "avx2", "avx512" or "neon") if  */
+/* the CPU supports them                                                 */
+
+int nn_select_kernels(const char* name) {
+	#if defined(NN_WITH_X86)
+		const int features = nn_cpu_features();
+	#else
+		const int features = 0;
 	#endif
 	
-	const int index_w = (piece_type << 1) + (piece_color);
-	const int index_b = (piece_type << 1) + (1 - piece_color);
+	for (size_t i = 0; i < sizeof(nn_kernels_all) / sizeof(nn_kernels_all[0]); i++) {
+		const NN_Kernels* kernels = nn_kernels_all[i];
+		
+		if (((kernels->cpu & features) == kernels->cpu) && ((name == NULL) || (strcmp(name, kernels->name) == 0))) {
+			nn_kernels = kernels;
+			nn_kernels_selected = 1;
+			
+			return 0;
+		}
+	}
+	
+	return -1;
+}
+
+#if defined(NN_WITH_INT8_W0)
+
+/* makes an 8-bit network the current one : W0 is read from w0 (in place */
+/* or a copy), and the rest is copied to network                         */
+
+static void nn_set_compact(const NN_CompactNetwork* compact, const int8_t* w0) {
+	memcpy(network.name, compact->name, sizeof(network.name));
+	memcpy(network.author, compact->author, sizeof(network.author));
+	
+	memcpy(network.B0, compact->B0, sizeof(network.B0));
+	memcpy(network.W1, compact->W1, sizeof(network.W1));
+	memcpy(network.B1, compact->B1, sizeof(network.B1));
+	
+	#if NN_SIZE_L3 != None
+	memcpy(network.W2, compact->W2, sizeof(network.W2));
+	memcpy(network.B2, compact->B2, sizeof(network.B2));
+	#endif
 	
-	#if defined(NN_DEBUG)
-		assert(index_w >= 0 && index_w < 12);
-		assert(index_b >= 0 && index_b < 12);
+	#if NN_SIZE_L4 != None
+	memcpy(network.W3, compact->W3, sizeof(network.W3));
+	memcpy(network.B3, compact->B3, sizeof(network.B3));
 	#endif
 	
-	const int sq_w = piece_position;
-	const int sq_b = piece_position ^ 56;
+	nn = &network;
+	nn_w0 = w0;
+	nn_w0_shift = compact->W0_shift;
+	nn_w0_16 = NULL; // no 16-bit weights to compare with
+}
+
+#endif
+
+/* FNV-1a of size bytes, continuing from hash                          */
+
+static uint32_t nn_fnv(uint32_t hash, const void* data, size_t size) {
+	const uint8_t* bytes = (const uint8_t*) data;
+	
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ bytes[i]) * 16777619u;
+	}
+	
+	return hash;
+}
+
+uint32_t nn_checksum(void) {
+	return nn_hash;
+}
+
+/* NULL loads the embedded network (if any) ; on failure, the current    */
+/* network is kept, so that a new one can be tried between games        */
+
+int nn_load(char* filename) {
+	const NN_Network* loaded = NULL;
+	const NN_CompactNetwork* compact = NULL; // or an 8-bit one,
 	
-	const int feature_w = (64 * index_w) + (sq_w);
-	const int feature_b = (64 * index_b) + (sq_b);
+	#if defined(NN_WITH_INT8_W0)
+		const int8_t* compact_w0 = NULL;     // whose W0 is read in place
+		NN_CompactNetwork* buffer = NULL;    // unless it was read in a copy
+	#endif
 	
-	#if defined(NN_DEBUG)
-		assert(feature_w >= 0 && feature_w < NN_SIZE_L0);
-		assert(feature_b >= 0 && feature_b < NN_SIZE_L0);
+	#if defined(NN_WITH_MMAP)
+		const void* view = NULL;
+		size_t view_size = 0;
 	#endif
 	
-	#if defined(NN_WITH_AVX)
-		__m256i acc, wei;
+	if (filename == NULL) {
+		#if defined(NN_EMBEDDED)
+			const size_t length = (size_t) (nn_embedded_end - nn_embedded_data);
+			
+			if (length >= sizeof(NN_Network)) {
+				loaded = (const NN_Network*) (const void*) nn_embedded_data;
+			#if defined(NN_WITH_INT8_W0)
+			} else if (length >= sizeof(NN_CompactNetwork)) {
+				compact = (const NN_CompactNetwork*) (const void*) nn_embedded_data;
+				compact_w0 = compact->W0;
+			#endif
+			} else {
+				return -1;
+			}
+		#else
+			return -1;
+		#endif
+	} else {
+		#if defined(NN_WITH_MMAP)
+			view = nn_map_file(filename, &view_size);
+			
+			if (view == NULL) {
+				return -1;
+			}
+			
+			if (view_size >= sizeof(NN_Network)) {
+				loaded = (const NN_Network*) view;
+			#if defined(NN_WITH_INT8_W0)
+			} else if (view_size >= sizeof(NN_CompactNetwork)) {
+				compact = (const NN_CompactNetwork*) view;
+				compact_w0 = compact->W0;
+			#endif
+			} else {
+				nn_unmap_file(view, view_size);
+				return -1;
+			}
+		#else
+			FILE* file = fopen(filename, "rb");
+			
+			if (file == NULL) {
+				return -1;
+			}
+			
+			// check the size first, a short read would leave half a network behind
+			fseek(file, 0, SEEK_END);
+			const long length = ftell(file);
+			fseek(file, 0, SEEK_SET);
+			
+			if (length >= (long) sizeof(NN_Network)) {
+				size_t read = fread(&network, sizeof(NN_Network), 1, file);
+				
+				fclose(file);
+				
+				if (read == 0) {
+					return -1;
+				}
+				
+				loaded = &network;
+			#if defined(NN_WITH_INT8_W0)
+			} else if (length >= (long) sizeof(NN_CompactNetwork)) {
+				// read into a copy, W0 going to W0_narrow and the rest to network
+				buffer = (NN_CompactNetwork*) malloc(sizeof(NN_CompactNetwork));
+				
+				size_t read = (buffer == NULL) ? 0 : fread(buffer, sizeof(NN_CompactNetwork), 1, file);
+				
+				fclose(file);
+				
+				if (read == 0) {
+					free(buffer);
+					return -1;
+				}
+				
+				memcpy(W0_narrow, buffer->W0, sizeof(W0_narrow));
+				
+				compact = buffer;
+				compact_w0 = W0_narrow;
+			#endif
+			} else {
+				fclose(file);
+				return -1;
+			}
+		#endif
+	}
+	
+	if (compact != NULL) {
+		#if defined(NN_WITH_INT8_W0)
+			nn_set_compact(compact, compact_w0);
+			free(buffer);
+		#endif
+	} else {
+		nn = loaded;
+		nn_w0_16 = nn->W0;
 		
-		// white's pov
-		for (int o = 0; o < NN_SIZE_L1; o += 16) {
-			acc = _mm256_loadu_si256((__m256i*)(void*) &accumulator[0][o]);
-			wei = _mm256_loadu_si256((__m256i*)(void*) &nn->W0[feature_w * NN_SIZE_L1 + o]);
-			acc = _mm256_add_epi16(acc, wei);
-			_mm256_storeu_si256((__m256i*)(void*) &accumulator[0][o], acc);
+		#if defined(NN_WITH_INT8_W0)
+			nn_w0_shift = nn_narrow_w0(nn->W0, W0_narrow);
+			nn_w0 = W0_narrow;
+		#else
+			nn_w0 = nn->W0;
+		#endif
+	}
+	
+	#if defined(NN_WITH_MMAP)
+		// the previous file is no longer used
+		if (nn_view != NULL) {
+			nn_unmap_file(nn_view, nn_view_size);
 		}
 		
-		// black's pov
-		for (int o = 0; o < NN_SIZE_L1; o += 16) {
-			acc = _mm256_loadu_si256((__m256i*)(void*) &accumulator[1][o]);
-			wei = _mm256_loadu_si256((__m256i*)(void*) &nn->W0[feature_b * NN_SIZE_L1 + o]);
-			acc = _mm256_add_epi16(acc, wei);
-			_mm256_storeu_si256((__m256i*)(void*) &accumulator[1][o], acc);
+		nn_view = view;
+		nn_view_size = view_size;
+	#endif
+	
+	#if defined(NN_WITH_SIMD)
+		for (int b = 0; b < NN_SIZE_L1 * 2 / 4; b++) {
+			for (int o = 0; o < NN_SIZE_L2; o++) {
+				for (int k = 0; k < 4; k++) {
+					W1_sparse[(b * NN_SIZE_L2 + o) * 4 + k] = nn->W1[o * NN_SIZE_L1 * 2 + b * 4 + k];
+				}
+			}
 		}
-	#else
-		for (int o = 0; o < NN_SIZE_L1; o++) {
-			accumulator[0][o] += nn->W0[feature_w * NN_SIZE_L1 + o];
-			accumulator[1][o] += nn->W0[feature_b * NN_SIZE_L1 + o];
+		
+		for (int o = 0; o < NN_SIZE_L2; o++) {
+			B1_scaled[o] = nn->B1[o] * FACTOR;
 		}
 	#endif
-}
-
-void nn_del_piece(NN_Accumulator accumulator, int piece_type, int piece_color, int piece_position) {
-	#if defined(NN_DEBUG)
-		assert(piece_type >= 0 && piece_type < 6);
-		assert(piece_color >= 0 && piece_color < 2);
-		assert(piece_position >= 0 && piece_position < 64);
+	
+	#if defined(NN_WITH_SIMD) && (NN_SIZE_L3 != None) && (NN_SIZE_L4 == 1)
+		for (int b = 0; b < NN_SIZE_L2 / 4; b++) {
+			for (int o = 0; o < NN_SIZE_L3; o++) {
+				for (int k = 0; k < 4; k++) {
+					W2_blocked[(b * NN_SIZE_L3 + o) * 4 + k] = nn->W2[o * NN_SIZE_L2 + b * 4 + k];
+				}
+			}
+		}
+		
+		for (int o = 0; o < NN_SIZE_L3; o++) {
+			B2_scaled[o] = nn->B2[o] * FACTOR;
+		}
 	#endif
 	
-	const int index_w = (piece_type << 1) + (piece_color);
-	const int index_b = (piece_type << 1) + (1 - piece_color);
+	if (!nn_kernels_selected) {
+		nn_select_kernels(NULL);
+	}
+	
+	nn_hash = nn_fnv(2166136261u, nn_w0, sizeof(nn_w0_t) * NN_SIZE_L0 * NN_SIZE_L1);
+	nn_hash = nn_fnv(nn_hash, &nn_w0_shift, sizeof(nn_w0_shift));
+	nn_hash = nn_fnv(nn_hash, nn->B0, sizeof(nn->B0));
+	nn_hash = nn_fnv(nn_hash, nn->W1, sizeof(nn->W1));
+	nn_hash = nn_fnv(nn_hash, nn->B1, sizeof(nn->B1));
 	
-	#if defined(NN_DEBUG)
-		assert(index_w >= 0 && index_w < 12);
-		assert(index_b >= 0 && index_b < 12);
+	#if NN_SIZE_L3 != None
+	nn_hash = nn_fnv(nn_hash, nn->W2, sizeof(nn->W2));
+	nn_hash = nn_fnv(nn_hash, nn->B2, sizeof(nn->B2));
+	#endif
+	
+	#if NN_SIZE_L4 != None
+	nn_hash = nn_fnv(nn_hash, nn->W3, sizeof(nn->W3));
+	nn_hash = nn_fnv(nn_hash, nn->B3, sizeof(nn->B3));
 	#endif
 	
-	const int sq_w = piece_position;
-	const int sq_b = piece_position ^ 56;
+	printf("info debug NN infos : %s by %s\n", nn->name, nn->author);
+	printf("info debug NN kernels : %s\n", nn_kernels->name);
+	
+	if (nn_w0_shift != 0) {
+		printf("info debug NN W0 : 8 bits, scaled down by %i (approximate)\n", 1 << nn_w0_shift);
+	}
 	
-	const int feature_w = (64 * index_w) + (sq_w);
-	const int feature_b = (64 * index_b) + (sq_b);
+	return 0;
+}
+
+/* the current network with W0 in 8 bits, narrowed from the 16-bit one */
+/* if there is one                                                      */
+
+int nn_save_compact(char* filename) {
+	NN_CompactNetwork* st = (NN_CompactNetwork*) calloc(1, sizeof(NN_CompactNetwork));
 	
-	#if defined(NN_DEBUG)
-		assert(feature_w >= 0 && feature_w < NN_SIZE_L0);
-		assert(feature_b >= 0 && feature_b < NN_SIZE_L0);
+	if (st == NULL) {
+		printf("info debug NN file : ERROR while allocating memory\n");
+		return -1;
+	}
+	
+	memcpy(st->name, nn->name, sizeof(st->name));
+	memcpy(st->author, nn->author, sizeof(st->author));
+	
+	if (nn_w0_16 != NULL) {
+		st->W0_shift = (int8_t) nn_narrow_w0(nn_w0_16, st->W0);
+	} else {
+		#if defined(NN_WITH_INT8_W0)
+			memcpy(st->W0, nn_w0, sizeof(st->W0));
+			st->W0_shift = (int8_t) nn_w0_shift;
+		#endif
+	}
+	
+	memcpy(st->B0, nn->B0, sizeof(st->B0));
+	memcpy(st->W1, nn->W1, sizeof(st->W1));
+	memcpy(st->B1, nn->B1, sizeof(st->B1));
+	
+	#if NN_SIZE_L3 != None
+	memcpy(st->W2, nn->W2, sizeof(st->W2));
+	memcpy(st->B2, nn->B2, sizeof(st->B2));
 	#endif
 	
-	#if defined(NN_WITH_AVX)
-		__m256i acc, wei;
-		
-		// white's pov
-		for (int o = 0; o < NN_SIZE_L1; o += 16) {
-			acc = _mm256_loadu_si256((__m256i*)(void*) &accumulator[0][o]);
-			wei = _mm256_loadu_si256((__m256i*)(void*) &nn->W0[feature_w * NN_SIZE_L1 + o]);
-			acc = _mm256_sub_epi16(acc, wei);
-			_mm256_storeu_si256((__m256i*)(void*) &accumulator[0][o], acc);
-		}
-		
-		// black's pov
-		for (int o = 0; o < NN_SIZE_L1; o += 16) {
-			acc = _mm256_loadu_si256((__m256i*)(void*) &accumulator[1][o]);
-			wei = _mm256_loadu_si256((__m256i*)(void*) &nn->W0[feature_b * NN_SIZE_L1 + o]);
-			acc = _mm256_sub_epi16(acc, wei);
-			_mm256_storeu_si256((__m256i*)(void*) &accumulator[1][o], acc);
-		}
-	#else
-		for (int o = 0; o < NN_SIZE_L1; o++) {
-			accumulator[0][o] -= nn->W0[feature_w * NN_SIZE_L1 + o];
-			accumulator[1][o] -= nn->W0[feature_b * NN_SIZE_L1 + o];
-		}
+	#if NN_SIZE_L4 != None
+	memcpy(st->W3, nn->W3, sizeof(st->W3));
+	memcpy(st->B3, nn->B3, sizeof(st->B3));
 	#endif
+	
+	FILE* file = fopen(filename, "wb");
+	
+	if (file == NULL) {
+		printf("info debug NN file : ERROR while saving network\n");
+		free(st);
+		return -1;
+	}
+	
+	size_t written = fwrite(st, sizeof(NN_CompactNetwork), 1, file);
+	
+	fclose(file);
+	free(st);
+	
+	return (written == 1) ? 0 : -1;
 }
 
-void nn_mov_piece(NN_Accumulator accumulator, int piece_type, int piece_color, int from, int to) {
-	#if defined(NN_DEBUG)
-		assert(piece_type >= 0 && piece_type < 6);
-		assert(piece_color >= 0 && piece_color < 2);
-		assert(from >= 0 && from < 64 && to >= 0 && to < 64);
-	#endif
+/* NULL unloads the small network, nn_evaluate_small() then uses the big */
+/* one ; on failure, the current small network is kept                   */
+
+int nn_load_small(char* filename) {
+	if (filename == NULL) {
+		nn_small = NULL;
+		return 0;
+	}
 	
-	const int index_w = (piece_type << 1) + (piece_color);
-	const int index_b = (piece_type << 1) + (1 - piece_color);
+	FILE* file = fopen(filename, "rb");
 	
-	#if defined(NN_DEBUG)
-		assert(index_w >= 0 && index_w < 12);
-		assert(index_b >= 0 && index_b < 12);
-	#endif
+	if (file == NULL) {
+		return -1;
+	}
+	
+	// a big network is not a small one
+	fseek(file, 0, SEEK_END);
+	const long length = ftell(file);
+	fseek(file, 0, SEEK_SET);
 	
-	const int fr_w = from;
-	const int fr_b = from ^ 56;
+	if ((length < (long) sizeof(NN_SmallNetwork)) || (length >= (long) sizeof(NN_CompactNetwork))) {
+		fclose(file);
+		return -1;
+	}
 	
-	const int to_w = to;
-	const int to_b = to ^ 56;
+	NN_SmallNetwork loaded;
+	size_t read = fread(&loaded, sizeof(NN_SmallNetwork), 1, file);
 	
-	const int feature_w_fr = (64 * index_w) + (fr_w);
-	const int feature_b_fr = (64 * index_b) + (fr_b);
+	fclose(file);
 	
-	const int feature_w_to = (64 * index_w) + (to_w);
-	const int feature_b_to = (64 * index_b) + (to_b);
+	if (read == 0) {
+		return -1;
+	}
 	
-	#if defined(NN_DEBUG)
-		assert(feature_w_fr >= 0 && feature_w_fr < NN_SIZE_L0);
-		assert(feature_b_fr >= 0 && feature_b_fr < NN_SIZE_L0);
-		assert(feature_w_to >= 0 && feature_w_to < NN_SIZE_L0);
-		assert(feature_b_to >= 0 && feature_b_to < NN_SIZE_L0);
-	#endif
+	small_network = loaded;
+	nn_small = &small_network;
 	
-	#if defined(NN_WITH_AVX)
-		__m256i acc, wei;
-		
-		// white's pov
-		for (int o = 0; o < NN_SIZE_L1; o += 16) {
-			acc = _mm256_loadu_si256((__m256i*)(void*) &accumulator[0][o]);
-			
-			wei = _mm256_loadu_si256((__m256i*)(void*) &nn->W0[feature_w_fr * NN_SIZE_L1 + o]);
-			acc = _mm256_sub_epi16(acc, wei);
-			
-			wei = _mm256_loadu_si256((__m256i*)(void*) &nn->W0[feature_w_to * NN_SIZE_L1 + o]);
-			acc = _mm256_add_epi16(acc, wei);
-			
-			_mm256_storeu_si256((__m256i*)(void*) &accumulator[0][o], acc);
-		}
-		
-		// black's pov
-		for (int o = 0; o < NN_SIZE_L1; o += 16) {
-			acc = _mm256_loadu_si256((__m256i*)(void*) &accumulator[1][o]);
-			
-			wei = _mm256_loadu_si256((__m256i*)(void*) &nn->W0[feature_b_fr * NN_SIZE_L1 + o]);
-			acc = _mm256_sub_epi16(acc, wei);
-			
-			wei = _mm256_loadu_si256((__m256i*)(void*) &nn->W0[feature_b_to * NN_SIZE_L1 + o]);
-			acc = _mm256_add_epi16(acc, wei);
-			
-			_mm256_storeu_si256((__m256i*)(void*) &accumulator[1][o], acc);
-		}
-	#else
-		for (int o = 0; o < NN_SIZE_L1; o++) {
-			accumulator[0][o] -= nn->W0[feature_w_fr * NN_SIZE_L1 + o];
-			accumulator[0][o] += nn->W0[feature_w_to * NN_SIZE_L1 + o];
-			
-			accumulator[1][o] -= nn->W0[feature_b_fr * NN_SIZE_L1 + o];
-			accumulator[1][o] += nn->W0[feature_b_to * NN_SIZE_L1 + o];
-		}
-	#endif
+	printf("info debug NN small : %s by %s\n", nn_small->name, nn_small->author);
+	
+	return 0;
+}
+
+void nn_init_accumulator(NN_Accumulator accumulator) {
+	memcpy(&(accumulator[0]), &(nn->B0[0]), NN_SIZE_L1 * sizeof(int16_t));
+	memcpy(&(accumulator[1]), &(nn->B0[0]), NN_SIZE_L1 * sizeof(int16_t));
+}
+
+void nn_add_piece(NN_Accumulator accumulator, int piece_type, int piece_color, int piece_position) {
+	nn_kernels->add_piece(accumulator, piece_type, piece_color, piece_position);
+}
+
+void nn_del_piece(NN_Accumulator accumulator, int piece_type, int piece_color, int piece_position) {
+	nn_kernels->del_piece(accumulator, piece_type, piece_color, piece_position);
+}
+
+void nn_mov_piece(NN_Accumulator accumulator, int piece_type, int piece_color, int from, int to) {
+	nn_kernels->mov_piece(accumulator, piece_type, piece_color, from, to);
+}
+
+void nn_update_accumulator(NN_Accumulator output, NN_Accumulator input, const NN_Change* del, int del_count, const NN_Change* add, int add_count) {
+	nn_kernels->update_accumulator(output, input, del, del_count, add, add_count);
 }
 
 void nn_update_all_pieces(NN_Accumulator accumulator, const uint64_t board[6][2]) {
@@ -632,52 +1262,68 @@ void nn_update_all_pieces(NN_Accumulator accumulator, const uint64_t board[6][2]
 	}
 }
 
-int nn_evaluate(NN_Accumulator accumulator, int color) {
-	#if defined(NN_DEBUG)
-		assert(color == 0 || color == 1);
-	#endif
-	
-	// layer 1 (concatenation of accumulators)
-	
-	int8_t L1[NN_SIZE_L1 * 2];
-	
-	for (int o = 0; o < NN_SIZE_L1; o++) {
-		L1[o             ] = nn_clamp_acc(accumulator[    color][o]);
-		L1[o + NN_SIZE_L1] = nn_clamp_acc(accumulator[1 - color][o]);
+int nn_reference_accumulator(NN_Accumulator accumulator, const uint64_t board[6][2]) {
+	if (nn_w0_16 == NULL) {
+		return -1;
 	}
 	
-	// layer 2
-	
-	#if NN_SIZE_L3 != None
-		int8_t L2[NN_SIZE_L2];
-		nn_compute_layer(L1, nn->W1, nn->B1, L2, NULL, NN_SIZE_L1 * 2, NN_SIZE_L2);
-	#else
-		int32_t L2[NN_SIZE_L2];
-		nn_compute_layer(L1, nn->W1, nn->B1, NULL, L2, NN_SIZE_L1 * 2, NN_SIZE_L2);
-	#endif
-	
-	// layer 3
+	nn_init_accumulator(accumulator);
 	
-	#if NN_SIZE_L3 != None
-		#if NN_SIZE_L4 != None
-			int8_t L3[NN_SIZE_L3];
-			nn_compute_layer(L2, nn->W2, nn->B2, L3, NULL, NN_SIZE_L2, NN_SIZE_L3);
-		#else
-			int32_t L3[NN_SIZE_L3];
-			nn_compute_layer(L2, nn->W2, nn->B2, NULL, L3, NN_SIZE_L2, NN_SIZE_L3);
-		#endif
-	#endif
+	for (int piece_color = 0; piece_color <= 1; piece_color++) {
+		for (int piece_type = 0; piece_type <= 5; piece_type++) {
+			uint64_t pieces = board[piece_type][piece_color];
+			
+			while (pieces) {
+				// as nn_add_piece(accumulator, 5 - piece_type, piece_color, position ^ 56)
+				const int piece_position = NN_GET_POSITION(pieces) ^ 56;
+				
+				const int index_w = ((5 - piece_type) << 1) + (piece_color);
+				const int index_b = ((5 - piece_type) << 1) + (1 - piece_color);
+				
+				const int16_t* w = &nn_w0_16[((64 * index_w) + (piece_position     )) * NN_SIZE_L1];
+				const int16_t* b = &nn_w0_16[((64 * index_b) + (piece_position ^ 56)) * NN_SIZE_L1];
+				
+				for (int o = 0; o < NN_SIZE_L1; o++) {
+					accumulator[0][o] += w[o];
+					accumulator[1][o] += b[o];
+				}
+				
+				NN_POP_POSITION(pieces);
+			}
+		}
+	}
 	
-	// layer 4
+	return 0;
+}
+
+int nn_evaluate(NN_Accumulator accumulator, int color) {
+	return nn_kernels->evaluate(accumulator, color);
+}
+
+void nn_evaluate_batch(NN_Accumulator* accumulators, const int* colors, int* evals, int count) {
+	nn_kernels->evaluate_batch(accumulators, colors, evals, count);
+}
+
+int nn_evaluate_small(NN_Accumulator accumulator, int color) {
+	if (nn_small == NULL) {
+		return nn_kernels->evaluate(accumulator, color);
+	}
 	
-	#if NN_SIZE_L4 != None
-		int32_t L4[NN_SIZE_L4];
-		nn_compute_layer(L3, nn->W3, nn->B3, NULL, L4, NN_SIZE_L3, NN_SIZE_L4);
-	#endif
+	return nn_kernels->evaluate_small(accumulator, color);
+}
+
+void nn_sparsity(NN_Accumulator accumulator, int color, int* inputs, int* blocks) {
+	alignas(64) int8_t L1[NN_SIZE_L1 * 2];
 	
-	// final evaluation
+	nn_clamp_accumulator_scalar(accumulator, color, L1);
 	
-	const float eval = ((float) (NN_LAST_LAYER[0])) / ((float) FACTOR);
+	*inputs = 0;
+	*blocks = 0;
 	
-	return (int) (100.0f * eval);
+	for (int i = 0; i < NN_SIZE_L1 * 2; i += 4) {
+		const int nonzero = (L1[i] != 0) + (L1[i + 1] != 0) + (L1[i + 2] != 0) + (L1[i + 3] != 0);
+		
+		*inputs += nonzero;
+		*blocks += (nonzero != 0);
+	}
 }
@@ -36,7 +36,11 @@
 #include <assert.h>
 #include <string.h>
 #include <inttypes.h>
-#include "immintrin.h"
+#if defined(__aarch64__) || defined(_M_ARM64)
+	#include <arm_neon.h>
+#else
+	#include "immintrin.h"
+#endif
 
 
 /****************************************************************************/
@@ -49,6 +53,26 @@
 // name of the default neural network file
 #define NN_FILE "Myrddin 094.nn"
 
+// name of the default small network file (optional, see nn_load_small())
+#define NN_SMALL_FILE "Myrddin 094 small.nn"
+
+// uncomment the following line to build the network file into the executable
+// (gcc or clang only), nn_load() then uses it when given a NULL file name
+//#define NN_EMBEDDED
+
+// map network files read-only instead of reading them, so that every engine
+// process shares the same physical copy of the weights
+#define NN_WITH_MMAP
+
+// first layer weights in 8 bits, half the cache footprint of 16-bit ones :
+// nn_load() narrows those of 16-bit files (exactly, unless some weights do
+// not fit in 8 bits), and reads the 8-bit files written by nn_save_compact()
+#define NN_WITH_INT8_W0
+
+// the most, in centipawns, that an evaluation with the 8-bit weights may
+// differ from the 16-bit one (see nn_reference_accumulator())
+#define NN_W0_MAX_ERROR 8
+
 #define None -1
 
 // network architecture
@@ -65,6 +89,19 @@
 
 typedef int16_t NN_Accumulator[2][NN_SIZE_L1];
 
+// a piece added to or removed from the board, see nn_update_accumulator()
+typedef struct {
+	int piece_type;
+	int piece_color;
+	int piece_position;
+} NN_Change;
+
+// a move never removes or adds more than two pieces (captures, castling)
+#define NN_MAX_CHANGES 2
+
+// number of positions that nn_evaluate_batch() computes together
+#define NN_BATCH_SIZE 4
+
 
 /****************************************************************************/
 /** PUBLIC FUNCTIONS                                                       **/
@@ -73,14 +110,58 @@ typedef int16_t NN_Accumulator[2][NN_SIZE_L1];
 int nn_convert(void);
 int nn_load(char* filename);
 
+// writes the current network with its first layer in 8 bits, a file that
+// nn_load() reads (the weights being scaled down if they do not all fit)
+int nn_save_compact(char* filename);
+
+// kernels for the instruction sets of the CPU, picked by the first nn_load() :
+// NULL for the fastest ones, or "scalar", "sse41", "avx2", "avx512" or "neon"
+// (-1 if the CPU does not support them)
+int nn_select_kernels(const char* name);
+
+// FNV-1a of the weights of the current network as the kernels read them, so
+// that scores saved with one network can be told from those of another
+uint32_t nn_checksum(void);
+
+// a second, much smaller network, that reads the accumulator of the first one
+// (so that nothing more has to be updated) ; NULL unloads it. Its file is, raw :
+//   char name[256], char author[256] ;
+//   int8_t W1[NN_SIZE_L1 * 2], the weights of the clamped accumulator, in the
+//   order of a row of the big network's W1 ;
+//   int8_t B1[1], the bias ;
+// the output is scaled like the big network's, see nn_evaluate()
+int nn_load_small(char* filename);
+
+// writes NN_SMALL_FILE from "network small.txt", in the text format of
+// "network.txt" (name=, author=, parameters= lines, then one value per line)
+// with the NN_SIZE_L1 * 2 weights of W1 followed by B1
+int nn_convert_small(void);
+
 void nn_init_accumulator(NN_Accumulator accumulator);
 
 void nn_add_piece(NN_Accumulator accumulator, int piece_type, int piece_color, int piece_position);
 void nn_del_piece(NN_Accumulator accumulator, int piece_type, int piece_color, int piece_position);
 void nn_mov_piece(NN_Accumulator accumulator, int piece_type, int piece_color, int from, int to);
 
+void nn_update_accumulator(NN_Accumulator output, NN_Accumulator input, const NN_Change* del, int del_count, const NN_Change* add, int add_count);
+
 void nn_update_all_pieces(NN_Accumulator accumulator, const uint64_t board[6][2]);
 
+// nn_update_all_pieces() with the 16-bit first layer weights, to measure the
+// error of the 8-bit ones (-1 if the network was read from an 8-bit file)
+int nn_reference_accumulator(NN_Accumulator accumulator, const uint64_t board[6][2]);
+
 int nn_evaluate(NN_Accumulator accumulator, int color);
 
+// evaluates count positions, the weights of the first hidden layer being read
+// once per NN_BATCH_SIZE positions instead of once per position
+void nn_evaluate_batch(NN_Accumulator* accumulators, const int* colors, int* evals, int count);
+
+// the small network's evaluation, several times faster than nn_evaluate() ;
+// the big network's when no small one is loaded
+int nn_evaluate_small(NN_Accumulator accumulator, int color);
+
+// number of non-zero inputs of the first hidden layer, and of non-zero blocks of 4 of them
+void nn_sparsity(NN_Accumulator accumulator, int color, int* inputs, int* blocks);
+
 #endif // CEREBRUM_H_INCLUDED
@@ -40,6 +40,8 @@ along with this program.If not, see < https://www.gnu.org/licenses/>.
 #if USE_HASH
 #define USE_HASH_IN_QS		FALSE
 #define USE_EVAL_HASH		TRUE
+#define USE_LOCKLESS_HASH	TRUE	// signature is stored XORed with the data word so torn entries fail the probe
+#define USE_LARGE_PAGES		TRUE	// allocate the hash tables with large pages when the OS allows it
 #endif
 
 #define USE_ASPIRATION		TRUE
@@ -67,6 +69,18 @@ along with this program.If not, see < https://www.gnu.org/licenses/>.
 
 #define USE_CEREBRUM_1_0	FALSE	
 
+#if USE_INCREMENTAL_ACC_UPDATE && !USE_CEREBRUM_1_0
+#define USE_LAZY_ACC_UPDATE	TRUE	// the search only records the pieces that change, and the accumulator is brought up to date when there's an eval
+#endif
+
+#if !USE_CEREBRUM_1_0
+#define USE_SMALL_NET		TRUE	// a small network, if one is loaded, evaluates deep qsearch nodes, and all but the first plies when short of time
+#endif
+
+#if USE_LAZY_ACC_UPDATE && USE_EVAL_HASH
+#define USE_QS_BATCH_EVAL	FALSE	// qsearch evaluates the positions after the captures it is about to search together, the evals going to the eval hash
+#endif
+
 #define TIME_BANK			500	// milliseconds clock to keep as a buffer
 #ifdef _DEBUG
 #define VERIFY_BOARD		TRUE
@@ -85,11 +99,7 @@ along with this program.If not, see < https://www.gnu.org/licenses/>.
 #define USE_SMP				FALSE
 #else
 #define USE_EGTB			TRUE
-#define USE_SMP				FALSE
-#endif
-
-#if USE_SMP
-#define DEBUG_SMP			FALSE	// adds lots of logging!
+#define USE_SMP				TRUE	// Lazy SMP with one search thread per core, all sharing the transposition table
 #endif
 
 #define SHOW_QS_NODES       FALSE
@@ -202,6 +212,9 @@ typedef struct
     UNDOMOVE		save_undo;
 } CHESSMOVE;
 
+// a move packed into 16 bits, for move lists and killers -- see MoveGen.h for the layout
+typedef unsigned short	PACKEDMOVE;
+
 typedef struct
 {
 	MoveFlagType	moveflag;
@@ -215,44 +228,13 @@ typedef struct
     PVMOVE		pv[MAX_DEPTH+10];
 } PV;
 
-extern BOOL			bSlave;
-extern int			nSlaveNum;
-
 #if USE_SMP
-#define MAX_CPUS			32
-#define NUM_SLAVE_STRINGS	8
-
-typedef struct
-{
-    char		szEngineCommand[NUM_SLAVE_STRINGS][256];
-	int			nNextToSend;
-	int			nNextToReceive;
-    int			nSearchNodes;
-	BOOL		bLocked;
-} SLAVE_DATA, *PSLAVE_DATA;
-
-typedef struct
-{
-	SLAVE_DATA	sdSlaveData[MAX_CPUS - 1];
-} SHARED_MEM, *PSHARED_MEM;
-
-typedef struct
-{
-    PVOID HashTable;
-    PVOID EvalHashTable;
-} SHARED_HASH, *PSHARED_HASH;
+#define MAX_CPUS			64
+#else
+#define MAX_CPUS			1
+#endif
 
 extern int			nCPUs;
-extern HANDLE		hSharedMem, hSharedHash;
-extern char			szSharedMemName[128];
-extern char			szSharedHashName[128];
-extern SHARED_MEM	*smSharedMem;
-extern SHARED_HASH  *shSharedHash;
-
-void KillProcesses(void);
-void StartProcesses(int nCPUs);
-void SendSlavesString(char *szString);
-#endif	// USE_SMP
 
 extern CHESSMOVE	cmGameMoveList[MAX_MOVE_LIST];
 
@@ -280,6 +262,9 @@ extern unsigned int	nFischerInc, nMovesBeforeControl;
 extern unsigned int nThinkTime, nPonderTime;
 extern ULONGLONG    nThinkStart;
 extern int			nClockRemaining;
+#if USE_SMALL_NET
+extern BOOL			bSmallNet;
+#endif
 extern unsigned int nCheckNodes, nThinkNodes;	// number of nodes to search before checking time management
 extern CHESSMOVE	cmChosenMove, cmPonderMove;
 extern FILE		   *logfile;